@@ -12,7 +12,7 @@
  * the page directory.
  */
 .text
-.globl _idt,_gdt,_pg_dir,_tmp_floppy_area
+.globl _idt,_gdt,_pg_dir,_empty_zero_page,_tmp_floppy_area
 _pg_dir:
 startup_32:
 	movl $0x10,%eax
@@ -108,8 +108,8 @@ setup_gdt:
 
 /*
  * I put the kernel page tables right after the page directory,
- * using 4 of them to span 16 Mb of physical memory. People with
- * more than 16MB will have to expand this.
+ * using 4 of them to span 16 Mb of physical memory. Memory above
+ * that gets its page tables from paging_init() in mm/memory.c.
  */
 .org 0x1000
 pg0:
@@ -124,6 +124,14 @@ pg2:
 pg3:
 
 .org 0x5000
+/*
+ * empty_zero_page is mapped read-only wherever a task reads memory it
+ * never wrote (see do_no_page()). It's below LOW_MEM, so mem_map[]
+ * doesn't count it, and nobody ever frees it.
+ */
+_empty_zero_page:
+
+.org 0x6000
 /*
  * tmp_floppy_area is used by the floppy-driver when DMA cannot
  * reach to a buffer-block. It needs to be aligned, so that it isn't
@@ -185,14 +193,9 @@ ignore_int:
  * will be mapped to some other place - mm keeps track of
  * that.
  *
- * For those with more memory than 16 Mb - tough luck. I've
- * not got it, why should you :-) The source is here. Change
- * it. (Seriously - it shouldn't be too difficult. Mostly
- * change some constants etc. I left it at 16Mb, as my machine
- * even cannot be extended past that (ok, but it was cheap :-)
- * I've tried to show which constants to change by having
- * some kind of marker at them (search for "16Mb"), but I
- * won't guarantee that's all :-( )
+ * Memory above 16Mb is mapped later, by paging_init(): the
+ * kernel segments span the 1Gb below TASK_BASE, and that is
+ * where all of memory ends up, 1:1.
  */
 .align 2
 setup_paging:
@@ -232,7 +235,7 @@ gdt_descr:
 _idt:	.fill 256,8,0		# idt is uninitialized  /* idt  */
 
 _gdt:	.quad 0x0000000000000000	/* NULL descriptor */ /* .quad һ8ֽڵֵ */
-	.quad 0x00c09a0000000fff	/* 16Mb */  /* gdt[1] */
-	.quad 0x00c0920000000fff	/* 16Mb */  /* gdt[2] */
+	.quad 0x00c39a000000ffff	/* 1Gb */  /* gdt[1] */
+	.quad 0x00c392000000ffff	/* 1Gb */  /* gdt[2] */
 	.quad 0x0000000000000000	/* TEMPORARY - don't use */
 	.fill 252,8,0			/* space for LDT's and TSS's etc */
@@ -30,7 +30,7 @@ extern int end;  // 由连接程序 ld 生成用于表明内核代码末端的
 struct buffer_head * start_buffer = (struct buffer_head *) &end;
 struct buffer_head * hash_table[NR_HASH];
 static struct buffer_head * free_list;
-static struct task_struct * buffer_wait = NULL;
+static struct wait_queue * buffer_wait = NULL;
 int NR_BUFFERS = 0;
 
 static inline void wait_on_buffer(struct buffer_head * bh)
@@ -118,7 +118,7 @@ void check_disk_change(int dev)
 {
 	int i;
 
-	if (MAJOR(dev) != 2)  // 是软盘设备吗？
+	if (MAJOR(dev) != FLOPPY_MAJOR)  // 是软盘设备吗？
 		return;
 	if (!floppy_change(dev & 0x03))  // 对应软盘是否已更换？
 		return;
@@ -222,10 +222,15 @@ struct buffer_head * get_hash_table(int dev, int block)
 struct buffer_head * getblk(int dev,int block)
 {
 	struct buffer_head * tmp, * bh;
+	int waited = 0;
 
 repeat:
-	if (bh = get_hash_table(dev,block))
+	if (bh = get_hash_table(dev,block)) {
+		/* we were woken for a free buffer we don't need: pass it on */
+		if (waited)
+			wake_up(&buffer_wait);
 		return bh;
+	}
 	tmp = free_list;
 	do {
 		if (tmp->b_count)  // 如果该缓冲区正被使用
@@ -238,7 +243,8 @@ repeat:
 /* and repeat until we find something good */
 	} while ((tmp = tmp->b_next_free) != free_list);
 	if (!bh) {
-		sleep_on(&buffer_wait);
+		sleep_on_exclusive(&buffer_wait);
+		waited = 1;
 		goto repeat;
 	}
 	wait_on_buffer(bh);
@@ -273,7 +279,8 @@ void brelse(struct buffer_head * buf)
 	wait_on_buffer(buf);
 	if (!(buf->b_count--))
 		panic("Trying to free free buffer");
-	wake_up(&buffer_wait);
+	if (!buf->b_count)
+		wake_up(&buffer_wait);
 }
 
 /*
@@ -311,28 +318,67 @@ __asm__("cld\n\t" \
  * a function of its own, as there is some speed to be got by reading them
  * all at the same time, not waiting for one to be read, and then another
  * etc.
+ *
+ * Blocks that aren't in the buffer cache don't go through it: they are
+ * read straight into the page, a request per run of consecutive ones,
+ * all queued before we wait on any, so they aren't copied, nor kept
+ * twice. Those that are there (being read ahead, say) are used as
+ * before. If a buffer for one of the others turns up while we read, it's
+ * the one that counts (it may be dirty), so it's copied over what we read.
  */
 // 读设备上一个页面（4个缓冲块）的内容到内存指定的地址 
 void bread_page(unsigned long address,int dev,int b[4])
 {
 	struct buffer_head * bh[4];
-	int i;
-
-	for (i=0 ; i<4 ; i++)
-		if (b[i]) {
-			if (bh[i] = getblk(dev,b[i]))
-				if (!bh[i]->b_uptodate)
-					ll_rw_block(READ,bh[i]);
-		} else
-			bh[i] = NULL;
+	struct buffer_head run[4];
+	int direct[4];
+	int i, j;
+
+	for (i=0 ; i<4 ; i++) {
+		bh[i] = NULL;
+		direct[i] = 0;
+		if (!b[i])
+			continue;
+	/* the floppy driver only does a block per request */
+		if (MAJOR(dev) != FLOPPY_MAJOR && !find_buffer(dev,b[i])) {
+			direct[i] = 1;
+			continue;
+		}
+		if (bh[i] = getblk(dev,b[i]))
+			if (!bh[i]->b_uptodate)
+				ll_rw_block(READ,bh[i]);
+	}
+	for (i=0 ; i<4 ; i = j) {
+		for (j = i+1 ; direct[i] && j<4 && direct[j] &&
+		     b[j] == b[j-1]+1 ; j++)
+			/* nothing */;
+		if (!direct[i])
+			continue;
+	/* a private, unhashed header for the run: queue it, don't wait */
+		run[i].b_data = (char *) (address + i*BLOCK_SIZE);
+		run[i].b_blocknr = b[i];
+		run[i].b_dev = dev;
+		run[i].b_uptodate = 0;
+		run[i].b_dirt = 0;
+		run[i].b_count = 1;
+		run[i].b_lock = 0;
+		run[i].b_wait = NULL;
+		ll_rw_block_run(READ,run+i,j-i);
+	}
 	// 将 4 块缓冲区上的内容顺序复制到指定地址处
-	for (i=0 ; i<4 ; i++,address += BLOCK_SIZE)
+	for (i=0 ; i<4 ; i++,address += BLOCK_SIZE) {
+		if (direct[i]) {
+			if (i == 0 || !direct[i-1] || b[i] != b[i-1]+1)
+				wait_on_buffer(run+i);
+			bh[i] = get_hash_table(dev,b[i]);
+		}
 		if (bh[i]) {
 			wait_on_buffer(bh[i]);
 			if (bh[i]->b_uptodate)
 				COPYBLK((unsigned long) bh[i]->b_data,address);
 			brelse(bh[i]);
 		}
+	}
 }
 
 /*
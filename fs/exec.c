@@ -46,6 +46,8 @@ int sys_uselib(const char * library)
 
 	if (get_limit(0x17) != TASK_SIZE)
 		return -EINVAL;
+	if (current->vfork_parent)	/* not in our parent's memory */
+		return -EINVAL;
 	if (library) {
 		if (!(inode=namei(library)))		/* get library inode */
 			return -ENOENT;
@@ -193,7 +195,7 @@ static unsigned long copy_strings(int argc,char ** argv,unsigned long *page,
 // 修改局部描述符表中的描述符基址和段限长，并将参数和环境空间页面放置在数据段末端。	  
 // 参数：text_size -- 执行文件头部中 a_text 字段给出的代码段长度值
 //		 page -- 参数和环境变量空间页面指针数组
-// 返回：数据段限长值(64MB)
+// 返回：数据段限长值(3GB)
 static unsigned long change_ldt(unsigned long text_size,unsigned long * page)
 {
 	unsigned long code_limit,data_limit,code_base,data_base;
@@ -236,6 +238,7 @@ int do_execve(unsigned long * eip,long tmp,char * filename,
 	int retval;
 	int sh_bang = 0;
 	unsigned long p=PAGE_SIZE*MAX_ARG_PAGES-4;
+	unsigned long dir = 0;
 
 	// eip[1]中是原代码段寄存器 cs，其中的选择符不可以是内核段选择符，也即内核不能调用本函数。
 	if ((0xffff & eip[1]) != 0x000f)
@@ -361,6 +364,11 @@ restart_interp:
 			goto exec_error2;
 		}
 	}
+/* after a vfork() the memory is the parent's: we need our own */
+	if (current->vfork_parent && !(dir = new_page_dir())) {
+		retval = -ENOMEM;
+		goto exec_error2;
+	}
 /* OK, This is the point of no return */
 /* note that current->library stays unchanged by an exec */
 	if (current->executable)
@@ -377,15 +385,22 @@ restart_interp:
 		if ((current->close_on_exec>>i)&1)
 			sys_close(i);
 	current->close_on_exec = 0;
+	current->flt_around = current->maj_flt = current->ra_hits = 0;
 	/* 旧代码/数据区域已经不需要，所以释放它们占用的物理内存页 */
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	if (dir) {
+		current->tss.cr3 = dir;
+		load_cr3(dir);
+		mm_release();
+	} else {
+		free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
+		free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	}
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
 	current->used_math = 0;
 	/* 在这个点 p 的值是(128KB-参数和环境总大小)，假如参数和环境的总大小是8KB，则 p=120KB */
-	p += change_ldt(ex.a_text,page);  /* p = 64MB + 120KB */
-	p -= LIBRARY_SIZE + MAX_ARG_PAGES*PAGE_SIZE; /* p= 64MB+120KB-4MB-128KB = 60MB-8KB */
+	p += change_ldt(ex.a_text,page);  /* p = 3GB + 120KB */
+	p -= LIBRARY_SIZE + MAX_ARG_PAGES*PAGE_SIZE; /* p= 3GB+120KB-4MB-128KB = 3GB-4MB-8KB */
 	p = (unsigned long) create_tables((char *)p,argc,envc);
 	current->brk = ex.a_bss +
 		(current->end_data = ex.a_data +
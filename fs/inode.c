@@ -31,7 +31,7 @@ static inline void lock_inode(struct m_inode * inode)
 {
 	cli();
 	while (inode->i_lock)
-		sleep_on(&inode->i_wait);
+		sleep_on_exclusive(&inode->i_wait);
 	inode->i_lock=1;
 	sti();
 }
@@ -32,11 +32,14 @@
  * have to have interrupts disabled throughout the select, but that's not really
  * such a loss: sleeping automatically frees interrupts when we aren't in this
  * task.
+ *
+ * With real wait queues this is simple: we just put an entry on every queue
+ * we are interested in, and take them all off again when we wake up.
  */
 
 typedef struct {
-	struct task_struct * old_task;
-	struct task_struct ** wait_address;
+	struct wait_queue wait;
+	struct wait_queue ** wait_address;
 } wait_entry;
 
 typedef struct {
@@ -44,7 +47,7 @@ typedef struct {
 	wait_entry entry[NR_OPEN*3];
 } select_table;
 
-static void add_wait(struct task_struct ** wait_address, select_table * p)
+static void add_wait(struct wait_queue ** wait_address, select_table * p)
 {
 	int i;
 
@@ -54,28 +57,18 @@ static void add_wait(struct task_struct ** wait_address, select_table * p)
 		if (p->entry[i].wait_address == wait_address)
 			return;
 	p->entry[p->nr].wait_address = wait_address;
-	p->entry[p->nr].old_task = * wait_address;
-	*wait_address = current;
+	p->entry[p->nr].wait.task = current;
+	p->entry[p->nr].wait.flags = 0;
+	add_wait_queue(wait_address,&p->entry[p->nr].wait);
 	p->nr++;
 }
 
 static void free_wait(select_table * p)
 {
 	int i;
-	struct task_struct ** tpp;
 
-	for (i = 0; i < p->nr ; i++) {
-		tpp = p->entry[i].wait_address;
-		while (*tpp && *tpp != current) {
-			(*tpp)->state = 0;
-			current->state = TASK_UNINTERRUPTIBLE;
-			schedule();
-		}
-		if (!*tpp)
-			printk("free_wait: NULL");
-		if (*tpp = p->entry[i].old_task)
-			(**tpp).state = 0;
-	}
+	for (i = 0; i < p->nr ; i++)
+		remove_wait_queue(p->entry[i].wait_address,&p->entry[i].wait);
 	p->nr = 0;
 }
 
@@ -35,7 +35,7 @@ static void lock_super(struct super_block * sb)
 {
 	cli();
 	while (sb->s_lock)
-		sleep_on(&(sb->s_wait));
+		sleep_on_exclusive(&(sb->s_wait));
 	sb->s_lock = 1;
 	sti();
 }
@@ -0,0 +1,59 @@
+#ifndef _ASM_APIC_H
+#define _ASM_APIC_H
+
+/*
+ * The local APIC of every CPU, and the (first) IO-APIC. Their registers
+ * live way up at 0xFEE00000 and 0xFEC00000, out of reach of the kernel
+ * segments, so smp_init() maps them at the top of kernel space, in the
+ * fixed mappings above MAX_MEMORY (see <linux/mm.h>). Every CPU sees
+ * its own local APIC at APIC_BASE.
+ */
+#define APIC_BASE	0x3FFFE000
+#define IO_APIC_BASE	0x3FFFF000
+
+#define APIC_DEFAULT_PHYS_BASE		0xFEE00000
+#define IO_APIC_DEFAULT_PHYS_BASE	0xFEC00000
+
+#define APIC_ID		0x020	/* id in bits 24-31 */
+#define APIC_VERSION	0x030
+#define APIC_TPR	0x080
+#define APIC_EOI	0x0B0
+#define APIC_SVR	0x0F0	/* spurious vector, bit 8 = enable */
+#define APIC_ICR	0x300	/* interrupt command, low word */
+#define APIC_ICR2	0x310	/* interrupt command, destination */
+#define APIC_LVTT	0x320	/* local timer */
+#define APIC_LVT0	0x350	/* LINT0 pin */
+#define APIC_LVT1	0x360	/* LINT1 pin */
+#define APIC_TMICT	0x380	/* timer initial count */
+#define APIC_TMCCT	0x390	/* timer current count */
+#define APIC_TDCR	0x3E0	/* timer divide config */
+
+#define APIC_SVR_ENABLE		0x100
+#define APIC_LVT_MASKED		0x10000
+#define APIC_LVT_PERIODIC	0x20000
+#define APIC_DM_NMI		0x00400
+#define APIC_DM_INIT		0x00500
+#define APIC_DM_STARTUP		0x00600
+#define APIC_DM_EXTINT		0x00700
+#define APIC_ICR_BUSY		0x01000
+#define APIC_ICR_ASSERT		0x04000
+#define APIC_TDR_DIV_1		0x0B
+
+/* vectors, see kernel/smp.c */
+#define APIC_TIMER_VECTOR	0x40
+#define RESCHEDULE_VECTOR	0x41
+#define SPURIOUS_VECTOR		0xFF
+
+#define apic_read(reg) (*(volatile unsigned long *) (APIC_BASE+(reg)))
+#define apic_write(reg,val) \
+	(*(volatile unsigned long *) (APIC_BASE+(reg)) = (val))
+
+/* the IO-APIC is indirect: select a register, then read the window */
+#define IO_APIC_SEL	0x00
+#define IO_APIC_WIN	0x10
+
+#define io_apic_read(reg) \
+	(*(volatile unsigned long *) (IO_APIC_BASE+IO_APIC_SEL) = (reg), \
+	*(volatile unsigned long *) (IO_APIC_BASE+IO_APIC_WIN))
+
+#endif
@@ -45,6 +45,63 @@ __asm__ ("movl %%esp,%%eax\n\t" \
 
 #define iret() __asm__ ("iret"::)  // 中断返回
 
+/* the time stamp counter: only on a Pentium or later, see sched_clock() */
+#define rdtscll(val) \
+__asm__ __volatile__("rdtsc":"=A" (val))
+
+/*
+ * save_flags/restore_flags are for code that may be called both with
+ * interrupts enabled and from interrupt level: cli() then restore,
+ * instead of an sti() that would re-enable interrupts in a handler.
+ */
+#define save_flags(x) \
+__asm__ __volatile__("pushfl ; popl %0":"=r" (x))
+
+#define restore_flags(x) \
+__asm__ __volatile__("pushl %0 ; popfl"::"r" (x))
+
+/*
+ * Spinlocks, for data other CPUs can get at. cli() only keeps out the
+ * interrupts of this CPU: the lock keeps out everybody else. Take them
+ * with the _irqsave versions if an interrupt handler can want the same
+ * lock, or it will spin forever on a lock its own CPU holds. They are
+ * compiler barriers as well: gcc mustn't move memory accesses across them.
+ */
+typedef struct {
+	volatile unsigned long lock;
+} spinlock_t;
+
+#define SPIN_LOCK_UNLOCKED { 0 }
+
+#define spin_lock_init(l) ((l)->lock = 0)
+
+#define spin_lock(l) \
+__asm__ __volatile__("1:\tmovl $1,%%eax\n\t" \
+	"xchgl %%eax,%0\n\t" \
+	"testl %%eax,%%eax\n\t" \
+	"je 3f\n" \
+	"2:\tcmpl $0,%0\n\t" \
+	"jne 2b\n\t" \
+	"jmp 1b\n" \
+	"3:" \
+	:"+m" ((l)->lock)::"ax","memory")
+
+#define spin_unlock(l) \
+__asm__ __volatile__("movl $0,%0":"+m" ((l)->lock)::"memory")
+
+/* returns non-zero if we got the lock */
+#define spin_trylock(l) ({ \
+unsigned long __old; \
+__asm__ __volatile__("xchgl %0,%1" \
+	:"=r" (__old),"+m" ((l)->lock):"0" (1):"memory"); \
+!__old;})
+
+#define spin_lock_irqsave(l,flags) \
+{ save_flags(flags); cli(); spin_lock(l); }
+
+#define spin_unlock_irqrestore(l,flags) \
+{ spin_unlock(l); restore_flags(flags); }
+
 // (0x8000+(dpl<<13)+(type<<8)) => desc_struct.b
 // addr(处理函数地址) => desc_struct.a
 #define _set_gate(gate_addr,type,dpl,addr) \
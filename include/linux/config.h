@@ -16,6 +16,20 @@
 #define DEF_SETUPSEG	0x9020
 #define DEF_SYSSIZE	0x3000
 
+/*
+ * Set TICKLESS_IDLE to 0 to keep the timer interrupt running at HZ while
+ * the machine is idle. Otherwise sched_init() lets the idle task stop it
+ * (see cpu_idle() in kernel/sched.c).
+ */
+#define TICKLESS_IDLE 1
+
+/*
+ * A fault on a page of an executable also maps the pages around it that
+ * other tasks have in memory already, up to FAULT_AROUND_PAGES of them
+ * (see do_no_page() in mm/memory.c). 1 turns that off.
+ */
+#define FAULT_AROUND_PAGES 16
+
 /*
  * The root-device is no longer hard-coded. You can change the default
  * root-device by changing the line ROOT_DEV = XXX in boot/bootsect.s
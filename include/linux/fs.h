@@ -7,6 +7,7 @@
 #define _FS_H
 
 #include <sys/types.h>
+#include <linux/wait.h>
 
 /* devices are as follows: (same as minix, so we can use the minix
  * file system. These are major numbers.)
@@ -33,6 +34,8 @@ void buffer_init(long buffer_end);
 #define MAJOR(a) (((unsigned)(a))>>8)
 #define MINOR(a) ((a)&0xff)
 
+#define FLOPPY_MAJOR 2
+
 #define NAME_LEN 14
 #define ROOT_INO 1
 
@@ -78,7 +81,7 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
-	struct task_struct * b_wait;
+	struct wait_queue * b_wait;
 	struct buffer_head * b_prev;
 	struct buffer_head * b_next;
 	struct buffer_head * b_prev_free;
@@ -104,8 +107,8 @@ struct m_inode {
 	unsigned char i_nlinks;
 	unsigned short i_zone[9];
 /* these are in memory also */
-	struct task_struct * i_wait;
-	struct task_struct * i_wait2;	/* for pipes */
+	struct wait_queue * i_wait;
+	struct wait_queue * i_wait2;	/* for pipes */
 	unsigned long i_atime;
 	unsigned long i_ctime;
 	unsigned short i_dev;
@@ -117,6 +120,9 @@ struct m_inode {
 	unsigned char i_mount;  /* 安装标志位，是否某个文件系统的挂载点 */
 	unsigned char i_seek;
 	unsigned char i_update;
+/* readahead for demand loading, see file_readahead() in mm/memory.c */
+	unsigned short i_ra_pages;
+	unsigned long i_ra_next, i_ra_start, i_ra_end;
 };
 
 struct file {
@@ -143,7 +149,7 @@ struct super_block {
 	struct m_inode * s_isup;   /* 该文件系统的根 i 节点 */
 	struct m_inode * s_imount; /* 该文件系统的被安装 i 节点 */
 	unsigned long s_time;
-	struct task_struct * s_wait;
+	struct wait_queue * s_wait;
 	unsigned char s_lock;
 	unsigned char s_rd_only;
 	unsigned char s_dirt;
@@ -192,7 +198,10 @@ extern struct m_inode * get_pipe_inode(void);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
+extern void ll_rw_block_run(int rw, struct buffer_head * bh, int nr);
 extern void ll_rw_page(int rw, int dev, int nr, char * buffer);
+extern void ll_rw_pages(int rw, int dev, int page, int nr, char * buffer);
+extern void ll_rw_blocks(int rw, int dev, int block, int nr, char * buffer);
 extern void brelse(struct buffer_head * buf);
 extern struct buffer_head * bread(int dev,int block);
 extern void bread_page(unsigned long addr,int dev,int b[4]);
@@ -8,14 +8,68 @@
 
 extern int SWAP_DEV;
 
-#define read_swap_page(nr,buffer) ll_rw_page(READ,SWAP_DEV,(nr),(buffer));
-#define write_swap_page(nr,buffer) ll_rw_page(WRITE,SWAP_DEV,(nr),(buffer));
+#define copy_page(from,to) \
+__asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024):"cx","di","si")
 
+/*
+ * Free memory is handed out in blocks of 2^order pages by the buddy
+ * allocator in page_alloc.c. get_free_page() is the usual way in: one
+ * page, cleared, swapping something out if it has to. The idle task
+ * clears some in advance: see zero_idle_page().
+ */
+#define NR_MEM_ORDERS 9		/* up to 1MB: the tables of a big swap area */
+
+extern int nr_free_pages;
+extern int pages_min, pages_low, pages_high;
+extern unsigned long alloc_pages(int order);
+extern void free_pages(unsigned long addr, int order);
 extern unsigned long get_free_page(void);
 extern unsigned long put_dirty_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
-void swap_free(int page_nr);
-void swap_in(unsigned long *table_ptr);
+extern unsigned long free_area_init(unsigned long start_mem);
+extern void show_free_areas(void);
+extern int zero_idle_page(void);
+extern int swap_out(void);
+extern struct wait_queue * kswapd_wait;
+
+/* what swap_out() has been doing: see try_to_swap_out() */
+struct reclaim_stats {
+	unsigned long scanned;		/* present pages looked at */
+	unsigned long referenced;	/* ... left alone as recently used */
+	unsigned long reclaimed;	/* ... and taken away */
+	unsigned long kswapd;		/* times kswapd went to work */
+	unsigned long direct;		/* allocations that had to swap out */
+	unsigned long swapped;		/* pages written to swap */
+	unsigned long swap_writes;	/* ... in this many requests */
+	unsigned long cache_hits;	/* swap-ins found in the swap cache */
+	unsigned long cache_drops;	/* clean cached pages let go */
+	unsigned long ra_hits;		/* pages read ahead that got used */
+	unsigned long ra_misses;	/* ... and that were dropped unused */
+};
+
+extern struct reclaim_stats reclaim_stats;
+
+/* the compressed swap pool, see zswap.c */
+struct zswap_stats {
+	unsigned long stored;		/* pages in the pool */
+	unsigned long bytes;		/* ... and what they take up there */
+	unsigned long pool_pages;	/* pages the pool has */
+	unsigned long loads;		/* pages brought back from it */
+	unsigned long rejected;		/* didn't compress well enough */
+	unsigned long pool_full;	/* ... or there was no room */
+};
+
+extern struct zswap_stats zswap_stats;
+extern int zswap_max_pages;
+extern void zswap_init(void);
+extern unsigned long zswap_store(unsigned long page);
+extern void zswap_load(unsigned long handle, unsigned long page);
+extern void zswap_free(unsigned long handle);
+void swap_free(int entry);
+void read_swap_page(int entry, char * buf);
+void swap_in(unsigned long *table_ptr, int write_access);
+int swap_duplicate(int entry);
+void delete_from_swap_cache(unsigned long page);
 
 extern inline volatile void oom(void)
 {
@@ -24,18 +78,75 @@ extern inline volatile void oom(void)
 }
 
 // 清除页高速缓冲
+/* reload cr3 with what's there: every task has a directory of its own */
 #define invalidate() \
-__asm__("movl %%eax,%%cr3"::"a" (0))
+__asm__("movl %%cr3,%%eax\n\tmovl %%eax,%%cr3":::"ax")
+
+/* switch page directories: tss.cr3 has to be set too, nobody saves cr3 */
+#define load_cr3(dir) \
+__asm__("movl %%eax,%%cr3"::"a" (dir))
+
+/*
+ * invalidate_page() flushes the TLB entry of just the page at linear
+ * address 'addr' in the current page directory, invalidate_range() the
+ * ones of the pages from 'start' up to 'end'. invlpg came with the 486:
+ * on a 386 they reload cr3 instead, as does invalidate_range() when
+ * there are so many pages that doing them one by one costs more than a
+ * full flush.
+ *
+ * All of these are for this cpu only: there are no shootdown IPIs. So
+ * nothing may change the page tables another cpu is running with in a
+ * way that needs a flush there: swap_out() leaves those alone.
+ */
+#define FLUSH_RANGE_MAX 32
+
+extern int has_invlpg;
+
+extern inline void invalidate_page(unsigned long addr)
+{
+	if (has_invlpg)
+		__asm__ __volatile__("invlpg %0"::"m" (*(char *) addr));
+	else
+		invalidate();
+}
+
+extern inline void invalidate_range(unsigned long start, unsigned long end)
+{
+	if (!has_invlpg || end - start > FLUSH_RANGE_MAX * PAGE_SIZE) {
+		invalidate();
+		return;
+	}
+	for (start &= 0xfffff000 ; start < end ; start += PAGE_SIZE)
+		__asm__ __volatile__("invlpg %0"::"m" (*(char *) start));
+}
+
+/*
+ * The directory entry of 'address' in the page directory at 'dir' (the
+ * tss.cr3 of a task). The kernel maps all of memory 1:1, so the
+ * physical address is good enough.
+ */
+#define PAGE_DIR_OFFSET(dir,address) \
+((unsigned long *) ((dir) + (((address)>>20) & 0xffc)))
 
 /* these are not to be changed without changing head.s etc */
 #define LOW_MEM 0x100000  // 1M
 extern unsigned long HIGH_MEMORY;
-#define PAGING_MEMORY (15*1024*1024)
-#define PAGING_PAGES (PAGING_MEMORY>>12)
 #define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
 #define USED 100
 
-extern unsigned char mem_map [ PAGING_PAGES ];
+/*
+ * head.s maps the first 16MB 1:1 into kernel space, paging_init() the
+ * rest of memory up to MAX_MEMORY. The last directory entry below
+ * TASK_BASE is left for pages that are mapped at fixed addresses, like
+ * the APICs. mem_map[] has one entry per page from LOW_MEM up to
+ * HIGH_MEMORY, and is set up by mem_init().
+ */
+#define MAX_MEMORY 0x3FC00000
+#define FIXMAP_BASE MAX_MEMORY
+
+extern unsigned long paging_pages;
+extern unsigned char * mem_map;
+extern unsigned long * page_swap;
 
 #define PAGE_DIRTY	0x40
 #define PAGE_ACCESSED	0x20
@@ -3,10 +3,17 @@
 
 #define HZ 100
 
-#define NR_TASKS	64
-#define TASK_SIZE	0x04000000      // 64 MB
+#define TASK_SIZE	0xC0000000      // 3 GB
 #define LIBRARY_SIZE	0x00400000 // 4 MB
 
+/*
+ * Every task has a page directory of its own, and sees its TASK_SIZE of
+ * memory at the same linear address, TASK_BASE. Everything below that
+ * belongs to the kernel and is the same in all the directories: the
+ * kernel gets the first GB of the linear space, user mode the other 3.
+ */
+#define TASK_BASE	0x40000000
+
 #if (TASK_SIZE & 0x3fffff)
 #error "TASK_SIZE must be multiple of 4M"
 #endif
@@ -19,8 +26,12 @@
 #error "LIBRARY_SIZE too damn big!"
 #endif
 
-#if (((TASK_SIZE>>16)*NR_TASKS) != 0x10000)
-#error "TASK_SIZE*NR_TASKS must be 4GB"
+#if (TASK_BASE & 0x3fffff)
+#error "TASK_BASE must be a multiple of 4M"
+#endif
+
+#if ((TASK_BASE>>16)+(TASK_SIZE>>16) > 0x10000)
+#error "TASK_BASE+TASK_SIZE must fit in 4GB"
 #endif
 
 #define LIBRARY_OFFSET (TASK_SIZE - LIBRARY_SIZE)
@@ -28,16 +39,17 @@
 #define CT_TO_SECS(x)	((x) / HZ)
 #define CT_TO_USECS(x)	(((x) % HZ) * 1000000/HZ)
 
-#define FIRST_TASK task[0]
-#define LAST_TASK task[NR_TASKS-1]
-
 #include <linux/head.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/timer.h>
+#include <linux/wait.h>
+#include <linux/smp.h>
 #include <sys/param.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <signal.h>
+#include <sched.h>
 
 #if (NR_OPEN > 32)
 #error "Currently the close-on-exec-flags and select masks are in one long, max 32 files/proc"
@@ -53,8 +65,11 @@
 #define NULL ((void *) 0)
 #endif
 
-extern int copy_page_tables(unsigned long from, unsigned long to, long size);
+extern int copy_page_tables(unsigned long from, unsigned long to, long size,
+	unsigned long dir);
 extern int free_page_tables(unsigned long from, unsigned long size);
+extern unsigned long new_page_dir(void);
+extern void free_page_dir(unsigned long dir);
 
 extern void sched_init(void);
 extern void schedule(void);
@@ -64,6 +79,29 @@ extern int tty_write(unsigned minor,char * buf,int count);
 
 typedef int (*fn_ptr)();
 
+/*
+ * The run queue. Every runnable task except task 0 sits on one of two
+ * arrays: 'active' holds tasks that still have time left in their slice,
+ * 'expired' holds tasks that used it up and already got their new one.
+ * Inside an array tasks are kept on circular lists indexed by 'counter'
+ * (the value schedule() always picked the maximum of), and 'bitmap' has
+ * a bit set for every non-empty level, so the best task is found with a
+ * single bsrl no matter how many tasks there are.
+ *
+ * Real-time tasks (SCHED_FIFO and SCHED_RR) are on a third array of the
+ * same kind, indexed by rt_priority, which is looked at before the
+ * other two. There are no slices to run out of there.
+ */
+#define NR_RQ_LEVELS	32
+
+struct task_struct;
+
+struct rq_array {
+	unsigned long bitmap;
+	int nr_running;
+	struct task_struct * queue[NR_RQ_LEVELS];
+};
+
 struct i387_struct {
 	long	cwd;
 	long	swd;
@@ -121,6 +159,15 @@ struct task_struct {
 	 * p->p_pptr->pid)
 	 */
 	struct task_struct	*p_pptr, *p_cptr, *p_ysptr, *p_osptr;
+/* hash chains by pid, pgrp and session, see kernel/fork.c */
+	struct task_struct *pidhash_next, **pidhash_pprev;
+	struct task_struct *pgrp_next, **pgrp_pprev;
+	struct task_struct *session_next, **session_pprev;
+/* all the tasks, on a circular list through task 0 */
+	struct task_struct *next_task, *prev_task;
+/* a vfork() child runs in its parent's memory, while the parent waits */
+	struct task_struct * vfork_parent;
+	struct wait_queue * vfork_wait;
 	unsigned short uid,euid,suid;
 	unsigned short gid,egid,sgid;
 	unsigned long timeout,alarm;
@@ -128,6 +175,30 @@ struct task_struct {
 	struct rlimit rlim[RLIM_NLIMITS]; 
 	unsigned int flags;	/* per process flags, defined below */
 	unsigned short used_math;
+/* scheduling policy and real-time priority, see <sched.h> */
+	int policy, rt_priority;
+/* run queue links, see kernel/sched.c */
+	struct task_struct *run_next, *run_prev;
+	struct rq_array * array;	/* NULL if not on the run queue */
+	int rq_level;
+	unsigned long rq_epoch;
+	int processor;		/* the CPU whose run queue we belong to */
+	int lock_depth;		/* kernel lock nesting while switched out */
+/* timers for 'timeout' and 'alarm' above */
+	struct timer_list timeout_timer, alarm_timer;
+/* the queue we were last woken from, and when (for wq_stats) */
+	struct wait_queue ** woken_from;
+	unsigned long woken_at;
+/* for sched_getstats(): when we were last queued, and whether by a wakeup */
+	struct sched_task_stats sched_info;
+	unsigned long long sched_queued;
+	int sched_woken;
+/*
+ * since the last exec(): faults we didn't take thanks to fault-around,
+ * pages we had to get from the file, and how many of those had been
+ * read ahead
+ */
+	unsigned long flt_around, maj_flt, ra_hits;
 /* file system info */
 	int tty;		/* -1 if no tty, so it must be signed */
 	unsigned short umask;
@@ -160,6 +231,9 @@ struct task_struct {
 /* pid etc.. */	0,0,0,0, \
 /* suppl grps*/ {NOGROUP,}, \
 /* proc links*/ &init_task.task,0,0,0, \
+/* hashes */	NULL,NULL,NULL,NULL,NULL,NULL, \
+/* tasks */	&init_task.task,&init_task.task, \
+/* vfork */	NULL,NULL, \
 /* uid etc */	0,0,0,0,0,0, \
 /* timeout */	0,0,0,0,0,0,0, \
 /* rlimits */   { {0x7fffffff, 0x7fffffff}, {0x7fffffff, 0x7fffffff},  \
@@ -167,6 +241,12 @@ struct task_struct {
 		  {0x7fffffff, 0x7fffffff}, {0x7fffffff, 0x7fffffff}}, \
 /* flags */	0, \
 /* math */	0, \
+/* policy */	SCHED_OTHER,0, \
+/* run queue */	NULL,NULL,NULL,0,0,0,0, \
+/* timers */	{NULL,},{NULL,}, \
+/* woken */	NULL,0, \
+/* stats */	{0,},0,0, \
+/* faults */	0,0,0, \
 /* fs info */	-1,0022,NULL,NULL,NULL,NULL,0, \
 /* filp */	{NULL,}, \
 	{ \
@@ -184,47 +264,113 @@ struct task_struct {
 	}, \
 }
 
-extern struct task_struct *task[NR_TASKS];
-extern struct task_struct *last_task_used_math;
-extern struct task_struct *current;
+/*
+ * A task and its kernel stack share a page. That of task 0 is static,
+ * the others come from get_free_page() in fork.
+ */
+union task_union {
+	struct task_struct task;
+	char stack[PAGE_SIZE];
+};
+
+extern union task_union init_task;
+
+/* every task but task 0 (and the idle tasks of the other CPUs) */
+#define for_each_task(p) \
+	for (p = &init_task.task ; (p = p->next_task) != &init_task.task ; )
+
+extern int nr_tasks, max_tasks;
+extern struct task_struct * child_reaper;
+extern struct task_struct *last_task_used_math_set[NR_CPUS];
+extern struct task_struct *current_set[NR_CPUS];
 extern unsigned long volatile jiffies;  // 从开机开始算起的滴答数(10ms/滴答)
 extern unsigned long startup_time;
 extern int jiffies_offset;
 
+/* each CPU has its own current task, and its own fpu */
+#define current (current_set[smp_processor_id()])
+#define last_task_used_math (last_task_used_math_set[smp_processor_id()])
+
+/* task 0, and the idle tasks of the other CPUs */
+#define is_idle(p) (!(p)->pid)
+
+#define rt_task(p) ((p)->policy != SCHED_OTHER)
+
+/* set when a CPU should schedule() as soon as it gets out of the kernel */
+extern int need_resched[NR_CPUS];
+extern struct sched_stats sched_stats;
+
 #define CURRENT_TIME (startup_time+(jiffies+jiffies_offset)/HZ)
 
-extern void add_timer(long jiffies, void (*fn)(void));
-extern void sleep_on(struct task_struct ** p);
-extern void interruptible_sleep_on(struct task_struct ** p);
-extern void wake_up(struct task_struct ** p);
+extern void sleep_on(struct wait_queue ** p);
+extern void sleep_on_exclusive(struct wait_queue ** p);
+extern void interruptible_sleep_on(struct wait_queue ** p);
+extern long interruptible_sleep_on_timeout(struct wait_queue ** p, long timeout);
+extern void wake_up(struct wait_queue ** p);
+extern void wake_up_all(struct wait_queue ** p);
+extern void wake_up_process(struct task_struct * p);
+extern void signal_wake_up(struct task_struct * p);
+extern void init_idle(struct task_struct * p, int cpu);
+
+/*
+ * Every task but the idle ones is on three hash chains: one by pid, and
+ * the ones of its process group and session, so that signalling a job
+ * only walks the tasks that are (or hash like) members of it.
+ */
+#define PIDHASH_SZ	128
+#define pid_hashfn(x)	((((x) >> 7) ^ (x)) & (PIDHASH_SZ - 1))
+
+extern struct task_struct * pidhash[PIDHASH_SZ];
+extern struct task_struct * pgrphash[PIDHASH_SZ];
+extern struct task_struct * sessionhash[PIDHASH_SZ];
+
+extern void hash_pid(struct task_struct * p);
+extern void unhash_pid(struct task_struct * p);
+extern void set_pgrp(struct task_struct * p, long pgrp);
+extern void set_session(struct task_struct * p, long session);
+extern struct task_struct * find_task_by_pid(long pid);
+extern void unlink_task(struct task_struct * p);
+extern void mm_release(void);
+extern int sched_best_cpu(void);
+extern int kernel_thread(void (*fn)(void));
+extern void process_timeout(unsigned long data);
+extern void process_alarm(unsigned long data);
 extern int in_group_p(gid_t grp);
 
 /*
  * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
  * 4-TSS0, 5-LDT0, 6-TSS1 etc ...
- */ 
+ *
+ * Tasks don't have descriptors of their own any more, or the gdt would
+ * limit how many of them there can be. Every CPU has two TSS/LDT pairs
+ * instead: 2*cpu is the one it starts out with, 2*cpu+1 the spare.
+ * schedule() points the spare at the task it switches to, and after
+ * the switch the pair of the task we left is the spare.
+ */
 #define FIRST_TSS_ENTRY 4
 #define FIRST_LDT_ENTRY (FIRST_TSS_ENTRY+1)
-// n -- 从0开始，指第0个任务
-// _TSS(n) -- 获取第n个任务在GDT表中TSS段描述符的地址偏移值（以gdt为起点）
-// _LDT(n) -- 获取第n个任务在GDT表中LDT段描述符的地址偏移值（以gdt为起点）
+// n -- 描述符对的编号，CPU cpu 使用第 2*cpu 和 2*cpu+1 对
+// _TSS(n) -- 获取第n对描述符中TSS段描述符的地址偏移值（以gdt为起点）
+// _LDT(n) -- 获取第n对描述符中LDT段描述符的地址偏移值（以gdt为起点）
 #define _TSS(n) ((((unsigned long) n)<<4)+(FIRST_TSS_ENTRY<<3))
 #define _LDT(n) ((((unsigned long) n)<<4)+(FIRST_LDT_ENTRY<<3))
 #define ltr(n) __asm__("ltr %%ax"::"a" (_TSS(n)))
 #define lldt(n) __asm__("lldt %%ax"::"a" (_LDT(n)))
-// 取当前运行任务的任务号(是任务数组中的索引值，与进程号pid不同)
-// 返回：n -- 当前任务号
-#define str(n) \
-__asm__("str %%ax\n\t" \
-	"subl %2,%%eax\n\t" \
-	"shrl $4,%%eax" \
-	:"=a" (n) \
-	:"a" (0),"i" (FIRST_TSS_ENTRY<<3))
+
+/* the pair the current task of each CPU was switched in with */
+extern int tss_pair[NR_CPUS];
+
 /*
- *	switch_to(n) should switch tasks to task nr n, first
- * checking that n isn't the current task, in which case it does nothing.
+ *	switch_to(p,n) should switch tasks to task p, first
+ * checking that p isn't the current task, in which case it does nothing.
  * This also clears the TS-flag if the task we switched to has used
- * tha math co-processor latest.
+ * tha math co-processor latest. 'n' is the descriptor pair that has been
+ * set up for p, see above.
+ *
+ * 'current' and 'last_task_used_math' are those of this CPU. Their
+ * addresses are worked out before the switch, so they are stale if we
+ * come back on another CPU: schedule() makes sure that the math test
+ * then fails, see there.
  */
 // 临时数据结构__tmp 用于组建 ljmp 指令的操作数。该操作数由 4 字节偏移
 // 址和 2 字节的段选择符组成。因此__tmp 中 a 的值是 32 位偏移值，而 b 
@@ -232,23 +378,24 @@ __asm__("str %%ax\n\t" \
 // 造成任务切换到该 TSS 对应的进程。对于造成任务切换的长跳转，a 值无用。
 // %0 -- 偏移地址(*&__tmp.a)
 // %1 -- 新的 TSS 选择符
-// dx -- 新任务 n 的 TSS 段选择符
-// ecx -- 新任务指针 task[n] 
-#define switch_to(n) {\
+// dx -- 新任务的 TSS 段选择符（第 n 对描述符）
+// ecx -- 新任务指针 p
+#define switch_to(p,n) {\
 struct {long a,b;} __tmp; \
-__asm__("cmpl %%ecx,_current\n\t" \
+__asm__("cmpl %%ecx,%2\n\t" \
 	"je 1f\n\t" \
 	"movw %%dx,%1\n\t" \
-	"xchgl %%ecx,_current\n\t" \
+	"xchgl %%ecx,%2\n\t" \
 /* 执行长跳转至 *&__tmp，造成任务切换 */ \
 	"ljmp %0\n\t" \
-	"cmpl %%ecx,_last_task_used_math\n\t" \
+	"cmpl %%ecx,%3\n\t" \
 	"jne 1f\n\t" \
 /* 新任务上次使用过协处理器，则清零 cr0 的 TS 标志 */ \
 	"clts\n" \
 	"1:" \
 	::"m" (*&__tmp.a),"m" (*&__tmp.b), \
-	"d" (_TSS(n)),"c" ((long) task[n])); \
+	"m" (current),"m" (last_task_used_math), \
+	"d" (_TSS(n)),"c" ((long) (p))); \
 }
 
 #define PAGE_ALIGN(n) (((n)+0xfff)&0xfffff000)
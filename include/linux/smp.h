@@ -0,0 +1,40 @@
+#ifndef _SMP_H
+#define _SMP_H
+
+/*
+ * Multiprocessor support, see kernel/smp.c. CPUs are numbered from 0
+ * (the one we booted on) to smp_num_cpus-1 in the order they came up.
+ * A CPU finds out which one it is from the id of its local APIC: until
+ * smp_init() has filled in apicid_to_cpu[], and on machines without an
+ * MP table, every id maps to 0, so uniprocessors are just CPU 0. The
+ * APIC is mapped from paging_init() on, so reading the id never faults.
+ *
+ * All of the kernel proper runs under one lock, taken on every way into
+ * the kernel (system calls, interrupts, faults) and dropped on the way
+ * out. It nests, and stays with the CPU across a task switch: the task
+ * switched to takes over the nesting depth it had when it was switched
+ * out (see schedule()).
+ */
+#define NR_CPUS		8
+#define NO_PROC_ID	0xFF
+
+#include <asm/apic.h>
+
+extern int smp_num_cpus;
+extern unsigned char apicid_to_cpu[256];
+
+#define smp_processor_id() (apicid_to_cpu[apic_read(APIC_ID) >> 24])
+
+extern int kernel_counter;
+extern void lock_kernel(void);
+extern void unlock_kernel(void);
+extern int release_kernel_lock(void);
+extern void reacquire_kernel_lock(int depth);
+
+extern void smp_init(void);
+extern void smp_commence(void);
+extern void smp_send_reschedule(int cpu);
+extern void smp_idle(void);
+extern void smp_local_timer(long cpl);
+
+#endif
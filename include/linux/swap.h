@@ -0,0 +1,12 @@
+#ifndef _LINUX_SWAP_H
+#define _LINUX_SWAP_H
+
+/*
+ * Flags for swapon(). Areas of a higher priority are used first: with
+ * SWAP_FLAG_PREFER the priority is in the low bits, otherwise the new
+ * area goes below all the others.
+ */
+#define SWAP_FLAG_PREFER	0x8000
+#define SWAP_FLAG_PRIO_MASK	0x7fff
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+/*
+ * Kernel timers. A timer_list belongs to whoever uses it (usually it is
+ * embedded in some other structure), so there is no table to run out of.
+ * add_timer() arranges for 'function(data)' to be called from the timer
+ * interrupt once jiffies reaches 'expires', del_timer() cancels it again.
+ * Pending timers live on a cascading timer wheel (see kernel/sched.c),
+ * which makes both of them O(1) however many timers there are.
+ *
+ * add_timer() on a timer that is already pending just moves it to the
+ * new expiry time.
+ */
+struct timer_list {
+	struct timer_list * next;
+	struct timer_list ** pprev;	/* NULL if not pending */
+	unsigned long expires;
+	unsigned long data;
+	void (*function)(unsigned long);
+};
+
+#define init_timer(t) ((t)->next = NULL, (t)->pprev = NULL)
+#define timer_pending(t) ((t)->pprev != NULL)
+
+extern void add_timer(struct timer_list * timer);
+extern int del_timer(struct timer_list * timer);
+extern void run_timer_list(void);
+
+#endif
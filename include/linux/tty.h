@@ -16,6 +16,7 @@
 extern int NR_CONSOLES;
 
 #include <termios.h>
+#include <linux/wait.h>
 
 #define TTY_BUF_SIZE 1024
 
@@ -23,7 +24,7 @@ struct tty_queue {
 	unsigned long data;
 	unsigned long head;
 	unsigned long tail;
-	struct task_struct * proc_list;
+	struct wait_queue * proc_list;
 	char buf[TTY_BUF_SIZE];
 };
 
@@ -0,0 +1,42 @@
+#ifndef _WAIT_H
+#define _WAIT_H
+
+/*
+ * Wait queues. A queue is just a pointer to a circular list of entries,
+ * one per sleeper, which live on the sleepers' kernel stacks. The pointer
+ * points to the last entry (NULL if nobody waits).
+ *
+ * Waiters that all want the same thing (a free buffer, a free request,
+ * a lock) sleep exclusively: wake_up() only wakes the first of those,
+ * as the others would just find it gone and go back to sleep. All the
+ * non-exclusive waiters are woken as before. Exclusive entries are kept
+ * at the end of the list, so they are woken in the order they came.
+ */
+#define WQ_FLAG_EXCLUSIVE	0x01
+
+struct task_struct;
+
+struct wait_queue {
+	struct task_struct * task;
+	struct wait_queue * next;
+	unsigned long flags;
+};
+
+/*
+ * 'spurious' counts tasks that went back to sleep on the queue they
+ * were just woken from, in the same clock tick: ie wakeups that did no
+ * good. 'exclusive_skipped' counts the sleepers an exclusive wakeup
+ * left alone, which the old wake-everybody code would have woken.
+ */
+struct wait_queue_stats {
+	unsigned long wakeups;
+	unsigned long exclusive_skipped;
+	unsigned long spurious;
+};
+
+extern struct wait_queue_stats wq_stats;
+
+extern void add_wait_queue(struct wait_queue ** p, struct wait_queue * wait);
+extern void remove_wait_queue(struct wait_queue ** p, struct wait_queue * wait);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _SCHED_PARAM_H
+#define _SCHED_PARAM_H
+
+/*
+ * Scheduling policies. SCHED_OTHER is the normal time-sharing one.
+ * SCHED_FIFO and SCHED_RR tasks run ahead of all of those, the highest
+ * sched_priority first: FIFO ones until they block or yield, RR ones
+ * take turns with the others of the same priority.
+ */
+#define SCHED_OTHER	0
+#define SCHED_FIFO	1
+#define SCHED_RR	2
+
+/* real-time priorities go from 1 to 31 */
+#define SCHED_PRIO_MIN	1
+#define SCHED_PRIO_MAX	31
+
+struct sched_param {
+	int sched_priority;
+};
+
+/*
+ * What sched_getstats() hands back. Times are in cycles of the time
+ * stamp counter, and stay 0 on CPUs that don't have one. Wakeup latency
+ * is from wake_up_process() to the task actually running: bucket n of
+ * the histogram counts the wakeups that took 2^n up to 2^(n+1)-1 cycles,
+ * the last one everything longer.
+ */
+#define SCHED_HIST_BUCKETS	32
+
+struct sched_task_stats {
+	unsigned long nvcsw;		/* switched out because it slept */
+	unsigned long nivcsw;		/* switched out while still runnable */
+	unsigned long pcount;		/* times it was switched to */
+	unsigned long long run_delay;	/* runnable, but waiting for a cpu */
+};
+
+struct sched_stats {
+	unsigned long nr_switches;
+	unsigned long nr_wakeups;
+	unsigned long nr_running;	/* on all the run queues, right now */
+	unsigned long latency_hist[SCHED_HIST_BUCKETS];
+};
+
+#endif
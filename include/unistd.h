@@ -146,6 +146,13 @@
 #define __NR_lstat	84
 #define __NR_readlink	85
 #define __NR_uselib	86
+#define __NR_sched_setscheduler	87
+#define __NR_sched_getscheduler	88
+#define __NR_sched_yield	89
+#define __NR_sched_getstats	90
+#define __NR_swapon	91
+#define __NR_swapoff	92
+#define __NR_vfork	93
 
 #define _syscall0(type,name) \
 type name(void) \
@@ -225,6 +232,7 @@ volatile void exit(int status);
 volatile void _exit(int status);
 int fcntl(int fildes, int cmd, ...);
 int fork(void);
+int vfork(void);
 int getpid(void);
 int getuid(void);
 int geteuid(void);
@@ -276,5 +284,15 @@ int getgroups(int gidsetlen, gid_t *gidset);
 int setgroups(int gidsetlen, gid_t *gidset);
 int select(int width, fd_set * readfds, fd_set * writefds,
 	fd_set * exceptfds, struct timeval * timeout);
+struct sched_param;
+int sched_setscheduler(pid_t pid, int policy, const struct sched_param * param);
+int sched_getscheduler(pid_t pid);
+int sched_yield(void);
+struct sched_task_stats;
+struct sched_stats;
+int sched_getstats(pid_t pid, struct sched_task_stats * task,
+	struct sched_stats * stats);
+int swapon(const char * specialfile, int swap_flags);
+int swapoff(const char * specialfile);
 
 #endif
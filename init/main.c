@@ -69,6 +69,8 @@ static int sprintf(char * str, const char *fmt, ...)
  * This is set up by the setup-routine at boot-time
  */
 #define EXT_MEM_K (*(unsigned short *)0x90002)
+#define E801_MEM_K (*(unsigned short *)0x901F0)
+#define E801_MEM_64K (*(unsigned short *)0x901F2)
 #define CON_ROWS ((*(unsigned short *)0x9000e) & 0xff)
 #define CON_COLS (((*(unsigned short *)0x9000e) & 0xff00) >> 8)
 #define DRIVE_INFO (*(struct drive_info *)0x90080)
@@ -136,10 +138,20 @@ void main(void)		/* This really IS void, no error here. */
 	envp[1] = term;	
 	envp_rc[1] = term;
  	drive_info = DRIVE_INFO;
-	memory_end = (1<<20) + (EXT_MEM_K<<10);
+/*
+ * The 0x88 call stops at 64MB (or earlier on some BIOSes): use the
+ * E801 numbers if setup.s got them. Above 16MB they come in 64kB.
+ */
+	if (E801_MEM_K) {
+		memory_end = E801_MEM_K + (E801_MEM_64K << 6);
+		if (memory_end > (MAX_MEMORY >> 10))
+			memory_end = MAX_MEMORY >> 10;
+		memory_end = (1<<20) + (memory_end<<10);
+	} else
+		memory_end = (1<<20) + (EXT_MEM_K<<10);
 	memory_end &= 0xfffff000;
-	if (memory_end > 16*1024*1024)
-		memory_end = 16*1024*1024;
+	if (memory_end > MAX_MEMORY)
+		memory_end = MAX_MEMORY;
 	if (memory_end > 12*1024*1024) 
 		buffer_memory_end = 4*1024*1024;
 	else if (memory_end > 6*1024*1024)
@@ -157,10 +169,12 @@ void main(void)		/* This really IS void, no error here. */
 	tty_init();
 	time_init();
 	sched_init();
+	smp_init();
 	buffer_init(buffer_memory_end);
 	hd_init();
 	floppy_init();
 	sti();
+	smp_commence();
 	move_to_user_mode();
 	if (!fork()) {		/* we count on this going ok */
 		init();
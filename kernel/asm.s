@@ -42,9 +42,13 @@ no_error_code:
 	mov %dx,%ds
 	mov %dx,%es
 	mov %dx,%fs
+	pushl %eax
+	call _lock_kernel
+	popl %eax
 	call *%eax  # *号表示是绝对调用操作数，与程序指针 PC 无关。
 				# 调用 C 函数 do_divide_error()
 	addl $8,%esp  # 堆栈指针重新指向寄存器 fs 入栈处
+	call _unlock_kernel
 	pop %fs
 	pop %es
 	pop %ds
@@ -126,8 +130,10 @@ error_code:
 	mov %ax,%ds
 	mov %ax,%es
 	mov %ax,%fs
+	call _lock_kernel
 	call *%ebx
 	addl $8,%esp
+	call _unlock_kernel
 	pop %fs
 	pop %es
 	pop %ds
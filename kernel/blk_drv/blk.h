@@ -27,7 +27,7 @@ struct request {
 	unsigned long sector;
 	unsigned long nr_sectors;
 	char * buffer;
-	struct task_struct * waiting;
+	struct task_struct * waiting;	/* for ll_rw_pages() */
 	struct buffer_head * bh;	// 缓冲区头指针 include/linux/fs.h
 	struct request * next;
 };
@@ -49,7 +49,7 @@ struct blk_dev_struct {
 
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];  // 块设备表，每种块设备占用一项
 extern struct request request[NR_REQUEST];
-extern struct task_struct * wait_for_request;
+extern struct wait_queue * wait_for_request;
 
 extern int * blk_size[NR_BLK_DEV];
 
@@ -82,6 +82,7 @@ extern int * blk_size[NR_BLK_DEV];
 #define DEVICE_NAME "harddisk"
 #define DEVICE_INTR do_hd
 #define DEVICE_TIMEOUT hd_timeout
+#define DEVICE_TIMEOUT_HANDLER hd_times_out
 #define DEVICE_REQUEST do_hd_request
 #define DEVICE_NR(device) (MINOR(device)/5)
 #define DEVICE_ON(device)
@@ -100,8 +101,25 @@ extern int * blk_size[NR_BLK_DEV];
 void (*DEVICE_INTR)(void) = NULL;
 #endif
 #ifdef DEVICE_TIMEOUT
+/*
+ * DEVICE_TIMEOUT is non-zero while we wait for an interrupt. The timer
+ * isn't cancelled when the interrupt arrives (that would mean doing it
+ * from the assembly handler), it just finds DEVICE_TIMEOUT cleared.
+ */
 int DEVICE_TIMEOUT = 0;
-#define SET_INTR(x) (DEVICE_INTR = (x),DEVICE_TIMEOUT = 200)
+
+static void device_timeout(unsigned long unused)
+{
+	if (DEVICE_TIMEOUT) {
+		DEVICE_TIMEOUT = 0;
+		DEVICE_TIMEOUT_HANDLER();
+	}
+}
+
+static struct timer_list device_timer = { NULL, NULL, 0, 0, device_timeout };
+
+#define SET_INTR(x) (DEVICE_INTR = (x),DEVICE_TIMEOUT = 1, \
+	device_timer.expires = jiffies + 200, add_timer(&device_timer))
 #else
 #define SET_INTR(x) (DEVICE_INTR = (x))
 #endif
@@ -127,7 +145,8 @@ extern inline void end_request(int uptodate)
 		printk("dev %04x, block %d\n\r",CURRENT->dev,
 			CURRENT->bh->b_blocknr);
 	}
-	wake_up(&CURRENT->waiting);  // 唤醒等待该请求项的进程
+	if (CURRENT->waiting)  // 唤醒等待该请求项的进程
+		wake_up_process(CURRENT->waiting);
 	wake_up(&wait_for_request);  // 唤醒等待出现空闲请求项的进程
 	CURRENT->dev = -1;			// 把该请求项置为空闲
 	CURRENT = CURRENT->next;	// 并移出请求链表
@@ -121,7 +121,7 @@ static unsigned char seek_track = 0;
 static unsigned char current_track = 255;
 static unsigned char command = 0;
 unsigned char selected = 0;
-struct task_struct * wait_on_floppy_select = NULL;
+struct wait_queue * wait_on_floppy_select = NULL;
 
 void floppy_deselect(unsigned int nr)
 {
@@ -402,6 +402,23 @@ static void reset_floppy(void)
 	sti();
 }
 
+static struct timer_list fd_timer = { NULL, NULL, 0, 0, NULL };
+
+/*
+ * Run 'fn' after 'ticks' clock ticks (right away if there's nothing to
+ * wait for). Only one of these is ever outstanding.
+ */
+static void fd_add_timer(long ticks, void (*fn)(void))
+{
+	if (ticks <= 0) {
+		fn();
+		return;
+	}
+	fd_timer.expires = jiffies + ticks;
+	fd_timer.function = (void (*)(unsigned long)) fn;
+	add_timer(&fd_timer);
+}
+
 static void floppy_on_interrupt(void)
 {
 /* We cannot do a floppy-select, as that might sleep. We just force it */
@@ -410,7 +427,7 @@ static void floppy_on_interrupt(void)
 		current_DOR &= 0xFC;
 		current_DOR |= current_drive;
 		outb(current_DOR,FD_DOR);
-		add_timer(2,&transfer);
+		fd_add_timer(2,&transfer);
 	} else
 		transfer();
 }
@@ -452,7 +469,7 @@ void do_fd_request(void)
 		command = FD_WRITE;
 	else
 		panic("do_fd_request: unknown command");
-	add_timer(ticks_to_floppy_on(current_drive),&floppy_on_interrupt);
+	fd_add_timer(ticks_to_floppy_on(current_drive),&floppy_on_interrupt);
 }
 
 static int floppy_sizes[] ={
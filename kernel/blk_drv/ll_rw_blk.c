@@ -23,7 +23,7 @@ struct request request[NR_REQUEST];
 /*
  * used to wait on when there are no free requests
  */
-struct task_struct * wait_for_request = NULL;
+struct wait_queue * wait_for_request = NULL;
 
 /* blk_dev_struct is:
  *	do_request-address
@@ -53,7 +53,7 @@ static inline void lock_buffer(struct buffer_head * bh)
 {
 	cli();  // 清中断许可
 	while (bh->b_lock)  // 如果缓冲区已被锁定，则睡眠，直到缓冲区解锁
-		sleep_on(&bh->b_wait);
+		sleep_on_exclusive(&bh->b_wait);
 	bh->b_lock=1;  // 立刻锁定该缓冲区
 	sti();  // 开中断
 }
@@ -104,7 +104,7 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
 	sti();
 }
 
-static void make_request(int major,int rw, struct buffer_head * bh)
+static void make_request(int major,int rw, struct buffer_head * bh, int nr)
 {
 	struct request * req;
 	int rw_ahead;
@@ -145,7 +145,7 @@ repeat:
 			unlock_buffer(bh);  // 如果是提前读/写请求，则解锁缓冲区并退出
 			return;
 		}
-		sleep_on(&wait_for_request);
+		sleep_on_exclusive(&wait_for_request);
 		goto repeat;
 	}
 /* fill up the request-info, and add it to the queue */
@@ -153,7 +153,7 @@ repeat:
 	req->cmd = rw;
 	req->errors=0;
 	req->sector = bh->b_blocknr<<1;
-	req->nr_sectors = 2; // 一次的读/写扇区数是 2
+	req->nr_sectors = nr<<1; // 一次的读/写扇区数，每块 2 个扇区
 	req->buffer = bh->b_data;
 	req->waiting = NULL;
 	req->bh = bh;
@@ -161,7 +161,14 @@ repeat:
 	add_request(major+blk_dev,req);
 }
 
-void ll_rw_page(int rw, int dev, int page, char * buffer)
+/*
+ * Read or write 'nr' blocks of 'dev', starting with block 'block', from
+ * or to 'buffer', as one request, and wait for it. The buffer has to be
+ * contiguous, and the driver has to take that many sectors at once:
+ * the hd driver takes up to 256. This doesn't go through the buffer
+ * cache: it's for swapping.
+ */
+void ll_rw_blocks(int rw, int dev, int block, int nr, char * buffer)
 {
 	struct request * req;
 	unsigned int major = MAJOR(dev);
@@ -178,15 +185,15 @@ repeat:
 		if (req->dev<0)
 			break;
 	if (req < request) {
-		sleep_on(&wait_for_request);
+		sleep_on_exclusive(&wait_for_request);
 		goto repeat;
 	}
 /* fill up the request-info, and add it to the queue */
 	req->dev = dev;
 	req->cmd = rw;
 	req->errors = 0;
-	req->sector = page<<3;  // 1 page = 8 sector
-	req->nr_sectors = 8;
+	req->sector = block<<1;
+	req->nr_sectors = nr<<1;
 	req->buffer = buffer;
 	req->waiting = current;
 	req->bh = NULL;
@@ -196,6 +203,16 @@ repeat:
 	schedule();
 }	
 
+void ll_rw_pages(int rw, int dev, int page, int nr, char * buffer)
+{
+	ll_rw_blocks(rw,dev,page<<2,nr<<2,buffer);  // 1 page = 4 blocks = 8 sectors
+}
+
+void ll_rw_page(int rw, int dev, int page, char * buffer)
+{
+	ll_rw_pages(rw,dev,page,1,buffer);
+}
+
 // 创建块设备读写请求项并插入到指定块设备请求队列中，
 // 实际的读写操作则是由设备的request_fn()函数完成
 void ll_rw_block(int rw, struct buffer_head * bh)
@@ -207,7 +224,26 @@ void ll_rw_block(int rw, struct buffer_head * bh)
 		printk("Trying to read nonexistent block-device\n\r");
 		return;
 	}
-	make_request(major,rw,bh);
+	make_request(major,rw,bh,1);
+}
+
+/*
+ * Like ll_rw_block(), but 'nr' consecutive blocks starting with
+ * bh->b_blocknr, to or from bh->b_data, in one request. The buffer is
+ * unlocked when the whole run is done, so the caller can queue several
+ * runs before waiting on any of them. 'bh' needn't be in the cache, but
+ * the driver has to take the sectors at once: not the floppy.
+ */
+void ll_rw_block_run(int rw, struct buffer_head * bh, int nr)
+{
+	unsigned int major;
+
+	if ((major=MAJOR(bh->b_dev)) >= NR_BLK_DEV ||
+	!(blk_dev[major].request_fn)) {
+		printk("Trying to read nonexistent block-device\n\r");
+		return;
+	}
+	make_request(major,rw,bh,nr);
 }
 
 void blk_dev_init(void)
@@ -50,6 +50,7 @@ rs_int:
 	pop %ds
 	pushl $0x10
 	pop %es
+	call _lock_kernel
 	movl 24(%esp),%edx  // 将缓冲队列指针地址存入 edx 寄存器
 	movl (%edx),%edx    // 取读缓冲队列结构指针(地址) -> edx
 						// 对于串行终端，data 字段存放着串行端口地址（端口号）
@@ -71,6 +72,7 @@ rep_int:				// 中断标识寄存器端口是 0x3fa 或 0x2fa
 	jmp rep_int
 end:	movb $0x20,%al  // 向中断控制器发送结束中断指令 EOI
 	outb %al,$0x20		/* EOI */
+	call _unlock_kernel
 	pop %ds
 	pop %es
 	popl %eax
@@ -83,6 +85,23 @@ end:	movb $0x20,%al  // 向中断控制器发送结束中断指令 EOI
 jmp_table:
 	.long modem_status,write_char,read_char,line_status
 
+/*
+ * Wake up the wait queue at %ebx (the address of a proc_list). Saves
+ * the registers gcc doesn't.
+ */
+.align 2
+wake_proc:
+	pushl %eax
+	pushl %ecx
+	pushl %edx
+	pushl %ebx
+	call _wake_up
+	addl $4,%esp
+	popl %edx
+	popl %ecx
+	popl %eax
+	ret
+
 .align 2
 modem_status:
 	addl $6,%edx		/* clear intr by reading modem status reg */
@@ -124,10 +143,10 @@ write_char:
 	je write_buffer_empty
 	cmpl $startup,%ebx  // 队列中字符数超过 256 个？
 	ja 1f  // 超过则跳转
-	movl proc_list(%ecx),%ebx	# wake up sleeping process
-	testl %ebx,%ebx			# is there any?
+	cmpl $0,proc_list(%ecx)		# is there any?
 	je 1f  // 空（0）则跳转
-	movl $0,(%ebx)  // 否则将进程置为可运行状态
+	leal proc_list(%ecx),%ebx	# wake up sleeping process
+	call wake_proc  // 否则将进程置为可运行状态
 1:	movl tail(%ecx),%ebx
 	movb buf(%ecx,%ebx),%al  // 从缓冲中尾指针处取一字符 -> al
 	outb %al,%dx  // 向端口 0x3f8(0x2f8) 送出到保持寄存器中
@@ -142,10 +161,10 @@ write_char:
 // 若有等待写该串行终端的进程则唤醒之，然后屏蔽发送
 // 保持寄存器空中断，不让发送保持寄存器空时产生中断
 write_buffer_empty:
-	movl proc_list(%ecx),%ebx	# wake up sleeping process
-	testl %ebx,%ebx			# is there any?
+	cmpl $0,proc_list(%ecx)		# is there any?
 	je 1f
-	movl $0,(%ebx)
+	leal proc_list(%ecx),%ebx	# wake up sleeping process
+	call wake_proc
 1:	incl %edx  // 指向端口 0x3f9(0x2f9)
 	inb %dx,%al  // 读取中断允许寄存器 -> al
 	jmp 1f
@@ -4,8 +4,6 @@
  *  (C) 1991  Linus Torvalds
  */
 
-#define DEBUG_PROC_TREE
-
 #include <errno.h>
 #include <signal.h>
 #include <sys/wait.h>
@@ -20,44 +18,42 @@ int sys_close(int fd);
 
 void release(struct task_struct * p)
 {
-	int i;
-
 	if (!p)
 		return;
 	if (p == current) {
 		printk("task releasing itself\n\r");
 		return;
 	}
-	for (i=1 ; i<NR_TASKS ; i++)
-		if (task[i]==p) {
-			task[i]=NULL;
-			/* Update links */
-			if (p->p_osptr)
-				p->p_osptr->p_ysptr = p->p_ysptr;
-			if (p->p_ysptr)
-				p->p_ysptr->p_osptr = p->p_osptr;
-			else
-				p->p_pptr->p_cptr = p->p_osptr;
-			free_page((long)p);
-			schedule();
-			return;
-		}
-	panic("trying to release non-existent task");
+	if (p->state != TASK_ZOMBIE || find_task_by_pid(p->pid) != p)
+		panic("trying to release non-existent task");
+	unlink_task(p);
+	unhash_pid(p);
+	/* Update links */
+	if (p->p_osptr)
+		p->p_osptr->p_ysptr = p->p_ysptr;
+	if (p->p_ysptr)
+		p->p_ysptr->p_osptr = p->p_osptr;
+	else
+		p->p_pptr->p_cptr = p->p_osptr;
+	if (p->tss.cr3 != (long) pg_dir)	/* see do_exit() */
+		free_page_dir(p->tss.cr3);
+	free_page((long)p);
+	schedule();
 }
 
 #ifdef DEBUG_PROC_TREE
 /*
- * Check to see if a task_struct pointer is present in the task[] array
+ * Check to see if a task_struct pointer is present in the task list
  * Return 0 if found, and 1 if not found.
  */
 int bad_task_ptr(struct task_struct *p)
 {
-	int 	i;
+	struct task_struct * q;
 
-	if (!p)
+	if (!p || p == &init_task.task)
 		return 0;
-	for (i=0 ; i<NR_TASKS ; i++)
-		if (task[i] == p)
+	for_each_task(q)
+		if (q == p)
 			return 0;
 	return 1;
 }
@@ -73,62 +69,60 @@ int bad_task_ptr(struct task_struct *p)
  */
 void audit_ptree()
 {
-	int	i;
+	struct task_struct * p;
 
-	for (i=1 ; i<NR_TASKS ; i++) {
-		if (!task[i])
-			continue;
-		if (bad_task_ptr(task[i]->p_pptr))
+	for_each_task(p) {
+		if (bad_task_ptr(p->p_pptr))
 			printk("Warning, pid %d's parent link is bad\n",
-				task[i]->pid);
-		if (bad_task_ptr(task[i]->p_cptr))
+				p->pid);
+		if (bad_task_ptr(p->p_cptr))
 			printk("Warning, pid %d's child link is bad\n",
-				task[i]->pid);
-		if (bad_task_ptr(task[i]->p_ysptr))
+				p->pid);
+		if (bad_task_ptr(p->p_ysptr))
 			printk("Warning, pid %d's ys link is bad\n",
-				task[i]->pid);
-		if (bad_task_ptr(task[i]->p_osptr))
+				p->pid);
+		if (bad_task_ptr(p->p_osptr))
 			printk("Warning, pid %d's os link is bad\n",
-				task[i]->pid);
-		if (task[i]->p_pptr == task[i])
+				p->pid);
+		if (p->p_pptr == p)
 			printk("Warning, pid %d parent link points to self\n");
-		if (task[i]->p_cptr == task[i])
+		if (p->p_cptr == p)
 			printk("Warning, pid %d child link points to self\n");
-		if (task[i]->p_ysptr == task[i])
+		if (p->p_ysptr == p)
 			printk("Warning, pid %d ys link points to self\n");
-		if (task[i]->p_osptr == task[i])
+		if (p->p_osptr == p)
 			printk("Warning, pid %d os link points to self\n");
-		if (task[i]->p_osptr) {
-			if (task[i]->p_pptr != task[i]->p_osptr->p_pptr)
+		if (p->p_osptr) {
+			if (p->p_pptr != p->p_osptr->p_pptr)
 				printk(
 			"Warning, pid %d older sibling %d parent is %d\n",
-				task[i]->pid, task[i]->p_osptr->pid,
-				task[i]->p_osptr->p_pptr->pid);
-			if (task[i]->p_osptr->p_ysptr != task[i])
+				p->pid, p->p_osptr->pid,
+				p->p_osptr->p_pptr->pid);
+			if (p->p_osptr->p_ysptr != p)
 				printk(
 		"Warning, pid %d older sibling %d has mismatched ys link\n",
-				task[i]->pid, task[i]->p_osptr->pid);
+				p->pid, p->p_osptr->pid);
 		}
-		if (task[i]->p_ysptr) {
-			if (task[i]->p_pptr != task[i]->p_ysptr->p_pptr)
+		if (p->p_ysptr) {
+			if (p->p_pptr != p->p_ysptr->p_pptr)
 				printk(
 			"Warning, pid %d younger sibling %d parent is %d\n",
-				task[i]->pid, task[i]->p_osptr->pid,
-				task[i]->p_osptr->p_pptr->pid);
-			if (task[i]->p_ysptr->p_osptr != task[i])
+				p->pid, p->p_osptr->pid,
+				p->p_osptr->p_pptr->pid);
+			if (p->p_ysptr->p_osptr != p)
 				printk(
 		"Warning, pid %d younger sibling %d has mismatched os link\n",
-				task[i]->pid, task[i]->p_ysptr->pid);
+				p->pid, p->p_ysptr->pid);
 		}
-		if (task[i]->p_cptr) {
-			if (task[i]->p_cptr->p_pptr != task[i])
+		if (p->p_cptr) {
+			if (p->p_cptr->p_pptr != p)
 				printk(
 			"Warning, pid %d youngest child %d has mismatched parent link\n",
-				task[i]->pid, task[i]->p_cptr->pid);
-			if (task[i]->p_cptr->p_ysptr)
+				p->pid, p->p_cptr->pid);
+			if (p->p_cptr->p_ysptr)
 				printk(
 			"Warning, pid %d youngest child %d has non-NULL ys link\n",
-				task[i]->pid, task[i]->p_cptr->pid);
+				p->pid, p->p_cptr->pid);
 		}
 	}
 }
@@ -143,7 +137,7 @@ static inline int send_sig(long sig,struct task_struct * p,int priv)
 		return -EPERM;
 	if ((sig == SIGKILL) || (sig == SIGCONT)) {
 		if (p->state == TASK_STOPPED)
-			p->state = TASK_RUNNING;
+			wake_up_process(p);
 		p->exit_code = 0;
 		p->signal &= ~( (1<<(SIGSTOP-1)) | (1<<(SIGTSTP-1)) |
 				(1<<(SIGTTIN-1)) | (1<<(SIGTTOU-1)) );
@@ -156,30 +150,35 @@ static inline int send_sig(long sig,struct task_struct * p,int priv)
 		p->signal &= ~(1<<(SIGCONT-1));
 	/* Actually deliver the signal */
 	p->signal |= (1<<(sig-1));
+	signal_wake_up(p);
 	return 0;
 }
 
+/*
+ * These walk the hash chain of the pgrp (or look the pid up), rather
+ * than all the tasks: the chain may have some other groups on it too.
+ */
 int session_of_pgrp(int pgrp)
 {
-	struct task_struct **p;
+	struct task_struct *p;
 
- 	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if ((*p)->pgrp == pgrp)
-			return((*p)->session);
+	for (p = pgrphash[pid_hashfn(pgrp)] ; p ; p = p->pgrp_next)
+		if (p->pgrp == pgrp)
+			return(p->session);
 	return -1;
 }
 
 int kill_pg(int pgrp, int sig, int priv)
 {
-	struct task_struct **p;
+	struct task_struct *p;
 	int err,retval = -ESRCH;
 	int found = 0;
 
 	if (sig<1 || sig>32 || pgrp<=0)
 		return -EINVAL;
- 	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if ((*p)->pgrp == pgrp) {
-			if (sig && (err = send_sig(sig,*p,priv)))
+	for (p = pgrphash[pid_hashfn(pgrp)] ; p ; p = p->pgrp_next)
+		if (p->pgrp == pgrp) {
+			if (sig && (err = send_sig(sig,p,priv)))
 				retval = err;
 			else
 				found++;
@@ -189,13 +188,12 @@ int kill_pg(int pgrp, int sig, int priv)
 
 int kill_proc(int pid, int sig, int priv)
 {
- 	struct task_struct **p;
+ 	struct task_struct *p;
 
 	if (sig<1 || sig>32)
 		return -EINVAL;
-	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if ((*p)->pid == pid)
-			return(sig ? send_sig(sig,*p,priv) : 0);
+	if (p = find_task_by_pid(pid))
+		return(sig ? send_sig(sig,p,priv) : 0);
 	return(-ESRCH);
 }
 
@@ -205,14 +203,14 @@ int kill_proc(int pid, int sig, int priv)
  */
 int sys_kill(int pid,int sig)
 {
-	struct task_struct **p = NR_TASKS + task;
+	struct task_struct *p;
 	int err, retval = 0;
 
 	if (!pid)
 		return(kill_pg(current->pid,sig,0));
 	if (pid == -1) {
-		while (--p > &FIRST_TASK)
-			if (err = send_sig(sig,*p,0))
+		for_each_task(p)
+			if (err = send_sig(sig,p,0))
 				retval = err;
 		return(retval);
 	}
@@ -232,16 +230,15 @@ int sys_kill(int pid,int sig)
  */
 int is_orphaned_pgrp(int pgrp)
 {
-	struct task_struct **p;
+	struct task_struct *p;
 
-	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-		if (!(*p) ||
-		    ((*p)->pgrp != pgrp) || 
-		    ((*p)->state == TASK_ZOMBIE) ||
-		    ((*p)->p_pptr->pid == 1))
+	for (p = pgrphash[pid_hashfn(pgrp)] ; p ; p = p->pgrp_next) {
+		if ((p->pgrp != pgrp) || 
+		    (p->state == TASK_ZOMBIE) ||
+		    (p->p_pptr->pid == 1))
 			continue;
-		if (((*p)->p_pptr->pgrp != pgrp) &&
-		    ((*p)->p_pptr->session == (*p)->session))
+		if ((p->p_pptr->pgrp != pgrp) &&
+		    (p->p_pptr->session == p->session))
 			return 0;
 	}
 	return(1);	/* (sighing) "Often!" */
@@ -249,12 +246,12 @@ int is_orphaned_pgrp(int pgrp)
 
 static int has_stopped_jobs(int pgrp)
 {
-	struct task_struct ** p;
+	struct task_struct * p;
 
-	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-		if ((*p)->pgrp != pgrp)
+	for (p = pgrphash[pid_hashfn(pgrp)] ; p ; p = p->pgrp_next) {
+		if (p->pgrp != pgrp)
 			continue;
-		if ((*p)->state == TASK_STOPPED)
+		if (p->state == TASK_STOPPED)
 			return(1);
 	}
 	return(0);
@@ -265,9 +262,19 @@ volatile void do_exit(long code)
 	struct task_struct *p;
 	int i;
 
+	/* the timers point at us, and this page is going away */
+	del_timer(&current->timeout_timer);
+	del_timer(&current->alarm_timer);
 	/* 释放当前进程代码段和数据段所占的内存页 */
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	if (current->vfork_parent) {
+	/* the memory is the parent's: keep out of it from now on */
+		current->tss.cr3 = (long) pg_dir;
+		load_cr3(pg_dir);
+		mm_release();
+	} else {
+		free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
+		free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	}
 	for (i=0 ; i<NR_OPEN ; i++)
 		if (current->filp[i])
 			sys_close(i);
@@ -300,6 +307,7 @@ volatile void do_exit(long code)
 	}
 	/* Let father know we died */
 	current->p_pptr->signal |= (1<<(SIGCHLD-1));
+	signal_wake_up(current->p_pptr);
 	
 	/*
 	 * This loop does two things:
@@ -311,9 +319,11 @@ volatile void do_exit(long code)
 	 */
 	if (p = current->p_cptr) {
 		while (1) {
-			p->p_pptr = task[1];
-			if (p->state == TASK_ZOMBIE)
-				task[1]->signal |= (1<<(SIGCHLD-1));
+			p->p_pptr = child_reaper;
+			if (p->state == TASK_ZOMBIE) {
+				child_reaper->signal |= (1<<(SIGCHLD-1));
+				signal_wake_up(child_reaper);
+			}
 			/*
 			 * process group orphan check
 			 * Case ii: Our child is in a different pgrp 
@@ -336,17 +346,16 @@ volatile void do_exit(long code)
 			 * and leave 
 			 */
 			/* 假如current->p_cptr是A，A的p_osptr是B，B的p_ysptr是A，并且A<=>B<=>C，
-			   task[1]->p_cptr是X，则链接后的情况是 A<=>B<=>C<=>X */ 
-			p->p_osptr = task[1]->p_cptr;
-			task[1]->p_cptr->p_ysptr = p;
-			task[1]->p_cptr = current->p_cptr;
+			   child_reaper->p_cptr是X，则链接后的情况是 A<=>B<=>C<=>X */ 
+			p->p_osptr = child_reaper->p_cptr;
+			child_reaper->p_cptr->p_ysptr = p;
+			child_reaper->p_cptr = current->p_cptr;
 			current->p_cptr = 0;
 			break;
 		}
 	}
 
 	if (current->leader) {
-		struct task_struct **p;
 		struct tty_struct *tty;
 		
 		/* 如果当前进程有控制终端 */
@@ -357,9 +366,10 @@ volatile void do_exit(long code)
 			tty->pgrp = 0;
 			tty->session = 0;
 		}
-	 	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-			if ((*p)->session == current->session)
-				(*p)->tty = -1;
+		for (p = sessionhash[pid_hashfn(current->session)] ; p ;
+		     p = p->session_next)
+			if (p->session == current->session)
+				p->tty = -1;
 	}
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
@@ -386,9 +396,11 @@ int sys_waitpid(pid_t pid,unsigned long * stat_addr, int options)
 	verify_area(stat_addr,4);
 repeat:
 	flag=0;
-	for (p = current->p_cptr ; p ; p = p->p_osptr) {
+	/* a single child is looked up by pid, not searched for */
+	p = (pid>0) ? find_task_by_pid(pid) : current->p_cptr;
+	for ( ; p ; p = (pid>0) ? NULL : p->p_osptr) {
 		if (pid>0) {
-			if (p->pid != pid)
+			if (p->p_pptr != current)
 				continue;
 		} else if (!pid) {
 			if (p->pgrp != current->pgrp)
@@ -413,9 +425,6 @@ repeat:
 				flag = p->pid;
 				put_fs_long(p->exit_code, stat_addr);
 				release(p);
-#ifdef DEBUG_PROC_TREE
-				audit_ptree();
-#endif
 				return flag;
 			default:
 				/* 如果子进程 p 的状态既不是停止也不是僵死，则 flag 置 1
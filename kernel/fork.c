@@ -18,9 +18,100 @@
 #include <asm/system.h>
 
 extern void write_verify(unsigned long address);
+extern void ret_from_fork(void);
 
 long last_pid=0;
 
+/*
+ * There's no task table any more: tasks are on the list through task 0,
+ * and there can be as many of them as max_tasks (set from the amount of
+ * memory by mem_init()) allows. child_reaper is init, who inherits the
+ * children of everybody that exits.
+ */
+int nr_tasks = 0;
+int max_tasks = 64;
+struct task_struct * child_reaper = NULL;
+
+struct task_struct * pidhash[PIDHASH_SZ];
+struct task_struct * pgrphash[PIDHASH_SZ];
+struct task_struct * sessionhash[PIDHASH_SZ];
+
+#define hash_in(head,p,next,pprev) { \
+	if (((p)->next = *(head)) != NULL) \
+		(*(head))->pprev = &(p)->next; \
+	*(head) = (p); \
+	(p)->pprev = (head); }
+
+#define hash_out(p,next,pprev) { \
+	if ((p)->next) \
+		(p)->next->pprev = (p)->pprev; \
+	*(p)->pprev = (p)->next; \
+	(p)->pprev = NULL; }
+
+void hash_pid(struct task_struct * p)
+{
+	hash_in(pidhash+pid_hashfn(p->pid),p,pidhash_next,pidhash_pprev);
+	hash_in(pgrphash+pid_hashfn(p->pgrp),p,pgrp_next,pgrp_pprev);
+	hash_in(sessionhash+pid_hashfn(p->session),p,session_next,session_pprev);
+}
+
+void unhash_pid(struct task_struct * p)
+{
+	hash_out(p,pidhash_next,pidhash_pprev);
+	hash_out(p,pgrp_next,pgrp_pprev);
+	hash_out(p,session_next,session_pprev);
+}
+
+void set_pgrp(struct task_struct * p, long pgrp)
+{
+	hash_out(p,pgrp_next,pgrp_pprev);
+	p->pgrp = pgrp;
+	hash_in(pgrphash+pid_hashfn(pgrp),p,pgrp_next,pgrp_pprev);
+}
+
+void set_session(struct task_struct * p, long session)
+{
+	hash_out(p,session_next,session_pprev);
+	p->session = session;
+	hash_in(sessionhash+pid_hashfn(session),p,session_next,session_pprev);
+}
+
+struct task_struct * find_task_by_pid(long pid)
+{
+	struct task_struct * p;
+
+	for (p = pidhash[pid_hashfn(pid)] ; p ; p = p->pidhash_next)
+		if (p->pid == pid)
+			return p;
+	return NULL;
+}
+
+static int pgrp_in_use(long pgrp)
+{
+	struct task_struct * p;
+
+	for (p = pgrphash[pid_hashfn(pgrp)] ; p ; p = p->pgrp_next)
+		if (p->pgrp == pgrp)
+			return 1;
+	return 0;
+}
+
+static void link_task(struct task_struct * p)
+{
+	p->next_task = &init_task.task;
+	p->prev_task = init_task.task.prev_task;
+	p->prev_task->next_task = p;
+	init_task.task.prev_task = p;
+	nr_tasks++;
+}
+
+void unlink_task(struct task_struct * p)
+{
+	p->prev_task->next_task = p->next_task;
+	p->next_task->prev_task = p->prev_task;
+	nr_tasks--;
+}
+
 void verify_area(void * addr,int size)
 {
 	unsigned long start;
@@ -39,7 +130,6 @@ void verify_area(void * addr,int size)
 }
 
 // 设置新任务的代码和数据段基址、限长，并复制页表
-// nr：新任务号
 // p：新任务数据结构指针
 /*
 0x17 即二进制 0001 0111，用选择符格式来解析该选择符，其表示的是，
@@ -50,7 +140,7 @@ void verify_area(void * addr,int size)
 检索 LDT 表，特权级 3，表的索引下标值是 1（第 2 项），
 而 LDT 表中的第 2 项表示“用户程序的代码段描述符项”。
 */
-int copy_mem(int nr,struct task_struct * p)
+int copy_mem(struct task_struct * p, int vfork)
 {
 	unsigned long old_data_base,new_data_base,data_limit;
 	unsigned long old_code_base,new_code_base,code_limit;
@@ -63,23 +153,44 @@ int copy_mem(int nr,struct task_struct * p)
 		panic("We don't support separate I&D");
 	if (data_limit < code_limit)
 		panic("Bad data_limit");
-	new_data_base = new_code_base = nr * TASK_SIZE;
+	new_data_base = new_code_base = TASK_BASE;
 	p->start_code = new_code_base;
 	set_base(p->ldt[1],new_code_base);
 	set_base(p->ldt[2],new_data_base);
-	if (copy_page_tables(old_data_base,new_data_base,data_limit)) {
-		free_page_tables(new_data_base,data_limit);  // 如果出错则释放申请的内存
+	if (vfork) {
+		p->tss.cr3 = current->tss.cr3;
+		return 0;
+	}
+	if (!(p->tss.cr3 = new_page_dir()))
+		return -ENOMEM;
+	if (copy_page_tables(old_data_base,new_data_base,data_limit,p->tss.cr3)) {
+		free_page_dir(p->tss.cr3);  // 如果出错则释放申请的内存
 		return -ENOMEM;
 	}
 	return 0;
 }
 
+/*
+ * A vfork() child is done with the memory of its parent: it has either
+ * got its own in exec(), or is exiting. The parent can go on.
+ */
+void mm_release(void)
+{
+	if (current->vfork_parent) {
+		current->vfork_parent = NULL;
+		wake_up(&current->vfork_wait);
+	}
+}
+
 /*
  *  Ok, this is the main fork-routine. It copies the system process
- * information (task[nr]) and sets up the necessary registers. It
- * also copies the data segment in it's entirety.
+ * information and sets up the necessary registers. It also copies the
+ * data segment in it's entirety.
+ *
+ * For a vfork() ('vfork' set) the child gets no memory of its own, but
+ * runs in that of the parent, which sleeps until mm_release().
  */
-int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
+int copy_process(long vfork,long pid,long ebp,long edi,long esi,long gs,long none,
 		long ebx,long ecx,long edx, long orig_eax, 
 		long fs,long es,long ds,
 		long eip,long cs,long eflags,long esp,long ss)
@@ -87,18 +198,34 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	struct task_struct *p;
 	int i;
 	struct file *f;
+	long *stack;
 
 	p = (struct task_struct *) get_free_page();
 	if (!p)
 		return -EAGAIN;
-	task[nr] = p;
 	*p = *current;	/* NOTE! this doesn't copy the supervisor stack */
 	p->state = TASK_UNINTERRUPTIBLE;
-	p->pid = last_pid;  // 新进程号，由前面调用 find_empty_process() 得到
+	p->array = NULL;	/* not on the run queue until we're done */
+	p->processor = sched_best_cpu();
+	p->lock_depth = 1;	/* ret_from_fork drops it */
+	p->pid = pid;  // 新进程号，由前面调用 find_empty_process() 得到
 	p->counter = p->priority;
+	p->sched_info.nvcsw = p->sched_info.nivcsw = 0;
+	p->sched_info.pcount = 0;
+	p->sched_info.run_delay = 0;
+	p->flt_around = p->maj_flt = p->ra_hits = 0;
 	p->signal = 0;
 	p->alarm = 0;
+	p->timeout = 0;
+	init_timer(&p->timeout_timer);
+	p->timeout_timer.data = (unsigned long) p;
+	p->timeout_timer.function = process_timeout;
+	init_timer(&p->alarm_timer);
+	p->alarm_timer.data = (unsigned long) p;
+	p->alarm_timer.function = process_alarm;
 	p->leader = 0;		/* process leadership doesn't inherit */
+	p->vfork_parent = vfork ? current : NULL;
+	p->vfork_wait = NULL;
 	p->utime = p->stime = 0;
 	p->cutime = p->cstime = 0;  // 初始化子进程用户态和核心态时间
 	p->start_time = jiffies;
@@ -121,12 +248,27 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->tss.ds = ds & 0xffff;
 	p->tss.fs = fs & 0xffff;
 	p->tss.gs = gs & 0xffff;
-	p->tss.ldt = _LDT(nr);
 	p->tss.trace_bitmap = 0x80000000;  // 高 16 位有效
+/*
+ * The child doesn't go straight to user mode: it starts in the kernel,
+ * at ret_from_fork, which irets to the user mode state above. The
+ * segment registers are the user ones all the same, ret_from_fork
+ * sees to that.
+ */
+	stack = (long *) (PAGE_SIZE + (long) p);
+	*--stack = ss & 0xffff;
+	*--stack = esp;
+	*--stack = eflags;
+	*--stack = cs & 0xffff;
+	*--stack = eip;
+	p->tss.eip = (long) ret_from_fork;
+	p->tss.eflags = eflags & ~0x200;	/* no interrupts until the iret */
+	p->tss.esp = (long) stack;
+	p->tss.cs = 0x08;
+	p->tss.ss = 0x10;
 	if (last_task_used_math == current)
 		__asm__("clts ; fnsave %0 ; frstor %0"::"m" (p->tss.i387));
-	if (copy_mem(nr,p)) {  // 设置新任务的代码和数据段基址、限长并复制页表
-		task[nr] = NULL;
+	if (copy_mem(p, vfork)) {  // 设置新任务的代码和数据段基址、限长并复制页表
 		free_page((long) p);
 		return -EAGAIN;
 	}
@@ -141,10 +283,7 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 		current->executable->i_count++;
 	if (current->library)
 		current->library->i_count++;
-	// 在 GDT 中设置新任务的 TSS 和 LDT 描述符，数据从 task 结构中取。
-	// 在任务切换时，任务寄存器 tr 由 CPU 自动加载
-	set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
-	set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
+	// 新任务的 TSS 和 LDT 描述符在调度到它时才由 schedule() 设置
 	p->p_pptr = current;
 	p->p_cptr = 0;
 	p->p_ysptr = 0;
@@ -152,24 +291,106 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	if (p->p_osptr)
 		p->p_osptr->p_ysptr = p;
 	current->p_cptr = p;
-	p->state = TASK_RUNNING;	/* do this last, just in case */
-	return last_pid;	// 返回新进程号（与任务号是不同的）
+	hash_pid(p);
+	link_task(p);
+	if (pid == 1)
+		child_reaper = p;
+	wake_up_process(p);	/* do this last, just in case */
+	while (p->vfork_parent)
+		sleep_on(&p->vfork_wait);
+	return pid;	// 返回新进程号
 }
 
-// 为新进程取得不重复的进程号 last_pid
-// 并返回任务数组中的任务号（即数组索引）
+// 为新进程取得不重复的进程号 last_pid 并返回它
 int find_empty_process(void)
 {
-	int i;
-
+	if (nr_tasks >= max_tasks)
+		return -EAGAIN;
 	repeat:
 		if ((++last_pid)<0) last_pid=1;
-		for(i=0 ; i<NR_TASKS ; i++)
-			if (task[i] && ((task[i]->pid == last_pid) ||
-				        (task[i]->pgrp == last_pid)))
-				goto repeat;
-	for(i=1 ; i<NR_TASKS ; i++)
-		if (!task[i])
-			return i;
-	return -EAGAIN;
+		if (find_task_by_pid(last_pid) || pgrp_in_use(last_pid))
+			goto repeat;
+	return last_pid;
+}
+
+/*
+ * A kernel thread starts here rather than at ret_from_fork: it takes
+ * over the kernel lock like schedule() would have, and "returns" to
+ * the function it was started at, which must never return itself.
+ */
+static void kernel_thread_tail(void)
+{
+	kernel_counter = current->lock_depth;
+	sti();
+}
+
+static void kernel_thread_died(void)
+{
+	panic("kernel thread returned");
+}
+
+/*
+ * Start a kernel thread at fn(). As far as the scheduler goes it is a
+ * task like any other, but it never goes to user mode: it runs on the
+ * kernel segments, in the page directory of task 0, with no files or
+ * inodes of its own. Task 0 is its parent, and never waits for it, so
+ * it had better not exit either. It holds the kernel lock whenever it
+ * runs, so it has to schedule() now and then.
+ */
+int kernel_thread(void (*fn)(void))
+{
+	struct task_struct *p;
+	long pid, *stack;
+
+	if ((pid = find_empty_process()) < 0)
+		return pid;
+	if (!(p = (struct task_struct *) get_free_page()))
+		return -EAGAIN;
+	*p = init_task.task;
+	p->state = TASK_UNINTERRUPTIBLE;
+	p->array = NULL;
+	p->processor = sched_best_cpu();
+	p->lock_depth = 1;
+	p->pid = pid;
+	p->counter = p->priority;
+	p->sched_info.nvcsw = p->sched_info.nivcsw = 0;
+	p->sched_info.pcount = 0;
+	p->sched_info.run_delay = 0;
+	p->signal = 0;
+	p->alarm = 0;
+	p->timeout = 0;
+	p->utime = p->stime = 0;
+	p->cutime = p->cstime = 0;
+	init_timer(&p->timeout_timer);
+	p->timeout_timer.data = (unsigned long) p;
+	p->timeout_timer.function = process_timeout;
+	init_timer(&p->alarm_timer);
+	p->alarm_timer.data = (unsigned long) p;
+	p->alarm_timer.function = process_alarm;
+	p->start_time = jiffies;
+	stack = (long *) (PAGE_SIZE + (long) p);
+	*--stack = (long) kernel_thread_died;
+	*--stack = (long) fn;
+	p->tss.back_link = 0;
+	p->tss.esp0 = PAGE_SIZE + (long) p;
+	p->tss.ss0 = 0x10;
+	p->tss.eip = (long) kernel_thread_tail;
+	p->tss.eflags = 0;	/* no interrupts until we have the lock */
+	p->tss.esp = (long) stack;
+	p->tss.cs = 0x08;
+	p->tss.ss = p->tss.ds = p->tss.es = 0x10;
+	p->tss.fs = p->tss.gs = 0x10;
+	p->tss.cr3 = (long) pg_dir;
+	p->tss.trace_bitmap = 0x80000000;
+	p->p_pptr = &init_task.task;
+	p->p_cptr = 0;
+	p->p_ysptr = 0;
+	p->p_osptr = init_task.task.p_cptr;
+	if (p->p_osptr)
+		p->p_osptr->p_ysptr = p;
+	init_task.task.p_cptr = p;
+	hash_pid(p);
+	link_task(p);
+	wake_up_process(p);
+	return pid;
 }
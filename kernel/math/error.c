@@ -11,6 +11,8 @@
 void math_error(void)
 {
 	__asm__("fnclex");
-	if (last_task_used_math)
+	if (last_task_used_math) {
 		last_task_used_math->signal |= 1<<(SIGFPE-1);
+		signal_wake_up(last_task_used_math);
+	}
 }
@@ -10,6 +10,7 @@
  * call functions (type getpid(), which just extracts a field from
  * current-task
  */
+#include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <linux/sys.h>
@@ -19,10 +20,13 @@
 #include <asm/segment.h>
 
 #include <signal.h>
+#include <errno.h>
 
 #define _S(nr) (1<<((nr)-1))
 #define _BLOCKABLE (~(_S(SIGKILL) | _S(SIGSTOP)))
 
+static unsigned long nr_running(void);
+
 void show_task(int nr,struct task_struct * p)
 {
 	int i,j = 4096-sizeof(struct task_struct);
@@ -33,6 +37,9 @@ void show_task(int nr,struct task_struct * p)
 	while (i<j && !((char *)(p+1))[i])
 		i++;
 	printk("%d/%d chars free in kstack\n\r",i,j);
+	printk("   cpu=%d, %d voluntary/%d involuntary switches, run delay %d kcycles\n\r",
+		p->processor, p->sched_info.nvcsw, p->sched_info.nivcsw,
+		(unsigned long) (p->sched_info.run_delay >> 10));
 	printk("   PC=%08X.", *(1019 + (unsigned long *) p));
 	if (p->p_ysptr || p->p_osptr) 
 		printk("   Younger sib=%d, older sib=%d\n\r", 
@@ -44,12 +51,17 @@ void show_task(int nr,struct task_struct * p)
 
 void show_state(void)
 {
-	int i;
+	struct task_struct * p;
+	int i = 0;
 
 	printk("\rTask-info:\n\r");
-	for (i=0;i<NR_TASKS;i++)
-		if (task[i])
-			show_task(i,task[i]);
+	show_task(i++,&init_task.task);
+	for_each_task(p)
+		show_task(i++,p);
+	printk("wait queues: %d wakeups, %d exclusive skipped, %d spurious\n\r",
+		wq_stats.wakeups, wq_stats.exclusive_skipped, wq_stats.spurious);
+	printk("scheduler: %d switches, %d wakeups, %d runnable\n\r",
+		sched_stats.nr_switches, sched_stats.nr_wakeups, nr_running());
 }
 
 #define LATCH (1193180/HZ)		// 定义每个时间片的滴答数
@@ -59,12 +71,10 @@ extern void mem_use(void);
 extern int timer_interrupt(void);		// kernel/system_call.s
 extern int system_call(void);		// kernel/system_call.s
 
-union task_union {				// 定义任务联合（任务结构成员和 stack 字符数组程序成员）
-	struct task_struct task;	// 因为一个任务的数据结构和它的内核态堆栈放在同一内存页
-	char stack[PAGE_SIZE];		// 中，所以从堆栈段寄存器 ss 可以获得它的数据段选择符。
-};
-
-static union task_union init_task = {INIT_TASK,};  // INIT_TASK 在 sched.h
+// 任务联合 task_union 在 sched.h 中定义（任务结构成员和 stack 字符数组程序成员）
+// 因为一个任务的数据结构和它的内核态堆栈放在同一内存页中，所以从堆栈段寄存器 ss
+// 可以获得它的数据段选择符。
+union task_union init_task = {INIT_TASK,};  // INIT_TASK 在 sched.h
 
 unsigned long volatile jiffies=0;	// 从开机开始算起的滴答数（10ms/滴答）
 unsigned long startup_time=0;		// 开机时间。从 1970:0:0:0 开始计时的秒数
@@ -74,10 +84,10 @@ int jiffies_offset = 0;		/* # clock ticks to add to get "true
 				   who like to syncronize their machines
 				   to WWV :-) */
 
-struct task_struct *current = &(init_task.task);
-struct task_struct *last_task_used_math = NULL;
+struct task_struct *current_set[NR_CPUS] = {&(init_task.task), };
+struct task_struct *last_task_used_math_set[NR_CPUS] = {NULL, };
 
-struct task_struct * task[NR_TASKS] = {&(init_task.task), };
+int tss_pair[NR_CPUS] = {0, };
 
 long user_stack [ PAGE_SIZE>>2 ] ;
 
@@ -109,6 +119,352 @@ void math_state_restore()
 	}
 }
 
+/*
+ * The run queues, see <linux/sched.h>. Every CPU has one of its own,
+ * and a task is on the queue of 'p->processor' until load_balance()
+ * moves it. 'epoch' counts how many times the two arrays have been
+ * switched, ie how many times every task on the queue has been given
+ * a new time-slice. Sleeping tasks aren't touched when that happens:
+ * they catch up on the refills they missed when they are woken.
+ */
+struct runqueue {
+	spinlock_t lock;
+	struct rq_array rt;
+	struct rq_array arrays[2];
+	struct rq_array * active, * expired;
+	unsigned long epoch;
+	struct task_struct * idle;
+	int balance_ticks;
+};
+
+static struct runqueue runqueues[NR_CPUS];
+
+#define cpu_rq(cpu) (runqueues + (cpu))
+#define rq_nr_running(rq) ((rq)->rt.nr_running + \
+	(rq)->active->nr_running + (rq)->expired->nr_running)
+
+#define BALANCE_TICKS (HZ/5)
+
+#define RQ_LEVEL(p) (rt_task(p) ? (p)->rt_priority : \
+	(p)->counter < NR_RQ_LEVELS ? (p)->counter : NR_RQ_LEVELS-1)
+
+int need_resched[NR_CPUS] = {0, };
+
+/*
+ * Scheduler statistics, for sched_getstats(). The counters are only
+ * changed under a run queue lock and the kernel lock, but read without
+ * either: a sample may be a switch or two out, which doesn't matter.
+ */
+struct sched_stats sched_stats = {0, };
+static int has_tsc = 0;
+
+static inline unsigned long long sched_clock(void)
+{
+	unsigned long long t = 0;
+
+	if (has_tsc)
+		rdtscll(t);
+	return t;
+}
+
+/* cpuid only exists if we can flip the ID flag, and a 386 can't */
+static int check_tsc(void)
+{
+	unsigned long a, b, d;
+
+	__asm__("pushfl ; popl %0 ; movl %0,%1\n\t"
+		"xorl $0x200000,%0 ; pushl %0 ; popfl\n\t"
+		"pushfl ; popl %0 ; pushl %1 ; popfl"
+		:"=&r" (a),"=&r" (b));
+	if (!((a ^ b) & 0x200000))
+		return 0;
+	__asm__("cpuid":"=a" (a),"=d" (d):"0" (1):"bx","cx");
+	return (d >> 4) & 1;
+}
+
+static unsigned long nr_running(void)
+{
+	unsigned long nr = 0;
+	int i;
+
+	for (i = 0 ; i < smp_num_cpus ; i++)
+		nr += rq_nr_running(cpu_rq(i));
+	return nr;
+}
+
+static inline int latency_bucket(unsigned long long delta)
+{
+	unsigned long hi = delta >> 32, lo = delta;
+	int n;
+
+	if (hi)
+		return SCHED_HIST_BUCKETS-1;
+	if (!lo)
+		return 0;
+	__asm__("bsrl %1,%0":"=r" (n):"r" (lo));
+	return n;
+}
+
+/*
+ * Account a switch from 'prev' to 'next', with the run queue locked.
+ * The counters of different CPUs need not agree, so a task that was
+ * moved over by load_balance() may seem to have waited less than
+ * nothing: that counts as no wait at all.
+ */
+static inline void account_switch(struct task_struct * prev,
+	struct task_struct * next)
+{
+	unsigned long long now = sched_clock(), delta;
+
+	sched_stats.nr_switches++;
+	if (!is_idle(prev)) {
+		if (prev->state == TASK_RUNNING) {
+			prev->sched_info.nivcsw++;
+			prev->sched_queued = now;
+			prev->sched_woken = 0;
+		} else
+			prev->sched_info.nvcsw++;
+	}
+	if (is_idle(next))
+		return;
+	next->sched_info.pcount++;
+	delta = (now > next->sched_queued) ? now - next->sched_queued : 0;
+	next->sched_info.run_delay += delta;
+	if (next->sched_woken) {
+		next->sched_woken = 0;
+		sched_stats.latency_hist[latency_bucket(delta)]++;
+	}
+}
+
+/* these must be called with the run queue locked */
+static inline void enqueue_task(struct task_struct * p, struct rq_array * array)
+{
+	int level = RQ_LEVEL(p);
+	struct task_struct * head = array->queue[level];
+
+	if (head) {
+		p->run_next = head;
+		p->run_prev = head->run_prev;
+		head->run_prev->run_next = p;
+		head->run_prev = p;
+	} else {
+		array->queue[level] = p->run_next = p->run_prev = p;
+		array->bitmap |= 1 << level;
+	}
+	p->rq_level = level;
+	p->array = array;
+	array->nr_running++;
+}
+
+static inline void dequeue_task(struct task_struct * p)
+{
+	struct rq_array * array = p->array;
+	int level = p->rq_level;
+
+	if (p->run_next == p) {
+		array->queue[level] = NULL;
+		array->bitmap &= ~(1 << level);
+	} else {
+		p->run_next->run_prev = p->run_prev;
+		p->run_prev->run_next = p->run_next;
+		if (array->queue[level] == p)
+			array->queue[level] = p->run_next;
+	}
+	p->run_next = p->run_prev = NULL;
+	p->array = NULL;
+	array->nr_running--;
+}
+
+/*
+ * A task that has used up its slice gets the next one right away, and
+ * waits on the expired array until everybody else has done the same.
+ */
+static inline void expire_task(struct task_struct * p, struct runqueue * rq)
+{
+	p->counter = (p->counter >> 1) + p->priority;
+	p->rq_epoch = rq->epoch + 1;
+	enqueue_task(p, rq->expired);
+}
+
+/* put a runnable task on the right array of 'rq' */
+static inline void activate_task(struct task_struct * p, struct runqueue * rq)
+{
+	if (rt_task(p))
+		enqueue_task(p, &rq->rt);
+	else if (p->counter > 0)
+		enqueue_task(p, rq->active);
+	else
+		expire_task(p, rq);
+}
+
+/*
+ * Does 'p' have to pre-empt what 'cpu' is running? Only real-time tasks
+ * do that: the time-sharing ones wait for the next tick like they
+ * always did.
+ */
+static inline void check_preempt(struct task_struct * p, int cpu)
+{
+	struct task_struct * curr = current_set[cpu];
+
+	if (!rt_task(p) || (rt_task(curr) && curr->rt_priority >= p->rt_priority))
+		return;
+	need_resched[cpu] = 1;
+	if (cpu != smp_processor_id())
+		smp_send_reschedule(cpu);
+}
+
+/*
+ * Apply the "counter = counter/2 + priority" refills a task missed while
+ * it was asleep. The value converges on 2*priority, so this stops after
+ * a few rounds however long the task slept.
+ */
+static inline void catch_up_counter(struct task_struct * p, struct runqueue * rq)
+{
+	unsigned long missed = rq->epoch - p->rq_epoch;
+	long c;
+
+	while (missed-- > 0) {
+		c = (p->counter >> 1) + p->priority;
+		if (c == p->counter)
+			break;
+		p->counter = c;
+	}
+	p->rq_epoch = rq->epoch;
+}
+
+/*
+ * wake_up_process() makes a task runnable. Everything that sets the state
+ * of another task to TASK_RUNNING has to go through here (or the assembly
+ * equivalents in keyboard.S and rs_io.s), as that is what puts it on the
+ * run queue. It can be called from interrupts. If the task's CPU is
+ * idling, it gets an IPI to come and have a look.
+ */
+void wake_up_process(struct task_struct * p)
+{
+	struct runqueue * rq;
+	unsigned long flags;
+	int cpu = p->processor;
+
+	rq = cpu_rq(cpu);
+	spin_lock_irqsave(&rq->lock, flags);
+	p->state = TASK_RUNNING;
+	if (!p->array && !is_idle(p)) {
+		catch_up_counter(p, rq);
+		activate_task(p, rq);
+		p->sched_queued = sched_clock();
+		p->sched_woken = 1;
+		sched_stats.nr_wakeups++;
+		if (cpu != smp_processor_id() && current_set[cpu] == rq->idle)
+			smp_send_reschedule(cpu);
+		else
+			check_preempt(p, cpu);
+	}
+	spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+/* the least loaded CPU, for a new task */
+int sched_best_cpu(void)
+{
+	int i, best = 0;
+
+	for (i = 1 ; i < smp_num_cpus ; i++)
+		if (rq_nr_running(cpu_rq(i)) < rq_nr_running(cpu_rq(best)))
+			best = i;
+	return best;
+}
+
+/* the first task on 'array' (best first) that isn't 'running' */
+static struct task_struct * pick_movable(struct rq_array * array,
+	struct task_struct * running)
+{
+	struct task_struct * p, * head;
+	unsigned long bitmap = array->bitmap;
+	int level;
+
+	while (bitmap) {
+		__asm__("bsrl %1,%0":"=r" (level):"r" (bitmap));
+		bitmap &= ~(1 << level);
+		p = head = array->queue[level];
+		do {
+			if (p != running)
+				return p;
+			p = p->run_next;
+		} while (p != head);
+	}
+	return NULL;
+}
+
+/*
+ * Move a task over from the busiest CPU, if it has at least two more
+ * runnable tasks than we do. Called with our own queue locked and
+ * interrupts off. The other lock is only tried: two CPUs pulling from
+ * each other would deadlock otherwise, and there's always next time.
+ * Expired tasks go first, as they won't run there for a while anyway,
+ * and the task the other CPU is running right now is left alone. So are
+ * real-time tasks.
+ */
+static void load_balance(struct runqueue * rq, int this_cpu)
+{
+	struct runqueue * busiest = NULL;
+	struct task_struct * p;
+	int i, nr, max, cpu = 0;
+
+	max = rq_nr_running(rq) + 1;
+	for (i = 0 ; i < smp_num_cpus ; i++) {
+		if (i == this_cpu)
+			continue;
+		if ((nr = rq_nr_running(cpu_rq(i))) > max) {
+			max = nr;
+			busiest = cpu_rq(i);
+			cpu = i;
+		}
+	}
+	if (!busiest || !spin_trylock(&busiest->lock))
+		return;
+	if (!(p = pick_movable(busiest->expired, current_set[cpu])))
+		p = pick_movable(busiest->active, current_set[cpu]);
+	if (p) {
+		dequeue_task(p);
+		p->processor = this_cpu;
+		p->rq_epoch = rq->epoch;
+		activate_task(p, rq);
+	}
+	spin_unlock(&busiest->lock);
+}
+
+/* from the timer interrupts, to even things out now and then */
+static void rebalance_tick(void)
+{
+	int cpu = smp_processor_id();
+	struct runqueue * rq = cpu_rq(cpu);
+
+	if (smp_num_cpus < 2 || --rq->balance_ticks > 0)
+		return;
+	rq->balance_ticks = BALANCE_TICKS;
+	spin_lock(&rq->lock);
+	load_balance(rq, cpu);
+	spin_unlock(&rq->lock);
+}
+
+/* tell the scheduler about the idle task of a CPU */
+void init_idle(struct task_struct * p, int cpu)
+{
+	cpu_rq(cpu)->idle = p;
+	current_set[cpu] = p;
+}
+
+/*
+ * Wake up an interruptible sleeper if it has a signal it will act on.
+ * Anybody posting a signal to another task has to call this, schedule()
+ * no longer goes looking for them.
+ */
+void signal_wake_up(struct task_struct * p)
+{
+	if (p->state == TASK_INTERRUPTIBLE &&
+	    (p->signal & ~(_BLOCKABLE & p->blocked)))
+		wake_up_process(p);
+}
+
 /*
  *  'schedule()' is the scheduler function. This is GOOD CODE! There
  * probably won't be any reason to change this, as it should work well
@@ -117,97 +473,254 @@ void math_state_restore()
  *
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
- * information in task[0] is never used.
+ * information in task 0 is never used.
+ *
+ * The choice itself is the same as it always was (the runnable task with
+ * the largest counter, and new slices for everybody when all of them are
+ * used up), but it is made from the run queue rather than by scanning
+ * every task: a task that stopped being runnable is taken off the queue
+ * here, wake_up_process() puts it back. Each CPU schedules from its own
+ * queue, and only looks at the others when it runs out.
+ *
+ * The kernel lock is held all through this, and the task we switch to
+ * takes over the depth it had: see <linux/smp.h>. That lock is also
+ * what keeps another CPU from picking 'prev' off the queue before we
+ * have switched away from it.
  */
 void schedule(void)
 {
-	int i,next,c;
-	struct task_struct ** p;
+	struct task_struct * prev, * next;
+	struct runqueue * rq;
+	struct rq_array * array;
+	unsigned long flags;
+	int level, cpu, pair;
 
-/* check alarm, wake up any interruptible tasks that have got a signal */
+	save_flags(flags);
+	cli();
+	cpu = smp_processor_id();
+	rq = cpu_rq(cpu);
+	prev = current_set[cpu];
 
-	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if (*p) {
-			if ((*p)->timeout && (*p)->timeout < jiffies) {
-				(*p)->timeout = 0;
-				if ((*p)->state == TASK_INTERRUPTIBLE)
-					(*p)->state = TASK_RUNNING;
-			}
-			if ((*p)->alarm && (*p)->alarm < jiffies) {
-				(*p)->signal |= (1<<(SIGALRM-1));
-				(*p)->alarm = 0;
+/*
+ * Timeouts and alarms are on the timer wheel, and signals wake their
+ * target when they are sent, so the only sleeper left to look at is
+ * the current task: it may be about to sleep with a signal already
+ * pending or a timeout already gone. Otherwise, arm its timeout timer.
+ * A timeout more than half the jiffies range away means "forever".
+ */
+	if (prev->state == TASK_INTERRUPTIBLE) {
+		if (prev->signal & ~(_BLOCKABLE & prev->blocked))
+			prev->state = TASK_RUNNING;
+		else if (prev->timeout) {
+			if (prev->timeout <= jiffies) {
+				prev->timeout = 0;
+				prev->state = TASK_RUNNING;
+			} else if (prev->timeout - jiffies < 0x80000000) {
+				prev->timeout_timer.expires = prev->timeout;
+				add_timer(&prev->timeout_timer);
 			}
-			if (((*p)->signal & ~(_BLOCKABLE & (*p)->blocked)) &&
-			(*p)->state==TASK_INTERRUPTIBLE)
-				(*p)->state=TASK_RUNNING;
 		}
+	}
 
 /* this is the scheduler proper: */
 
-	while (1) {
-		c = -1;
-		next = 0;
-		i = NR_TASKS;
-		p = &task[NR_TASKS];
-		while (--i) {  /* 任务0不参与剩余时间片的比较 */
-			if (!*--p)
-				continue;
-			if ((*p)->state == TASK_RUNNING && (*p)->counter > c)
-				c = (*p)->counter, next = i;
+	spin_lock(&rq->lock);
+	need_resched[cpu] = 0;
+/*
+ * A real-time task keeps its place if it is still runnable: it was
+ * only pre-empted, or it is FIFO and that's how FIFO works. An RR one
+ * that used up its slice goes to the back of its level with a new one.
+ */
+	if (prev->state == TASK_RUNNING && rt_task(prev) &&
+	    prev->array == &rq->rt) {
+		if (prev->policy == SCHED_RR && prev->counter <= 0) {
+			prev->counter = prev->priority;
+			dequeue_task(prev);
+			enqueue_task(prev, &rq->rt);
 		}
-		if (c) break;  
-		/* 处于running状态的任务，它们剩余的时间片都用完了，
-		   则全部重新分配时间片，包括不处于running状态的任务，但不包括任务0 */
-		for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-			if (*p)
-				(*p)->counter = ((*p)->counter >> 1) +
-						(*p)->priority;
+	} else {
+		if (prev->array)
+			dequeue_task(prev);
+		if (prev->state == TASK_RUNNING && !is_idle(prev))
+			activate_task(prev, rq);
+	}
+	if (!rq_nr_running(rq) && smp_num_cpus > 1)
+		load_balance(rq, cpu);
+	if (!rq->active->bitmap && rq->expired->bitmap) {
+		array = rq->active;
+		rq->active = rq->expired;
+		rq->expired = array;
+		rq->epoch++;
 	}
-	switch_to(next);
+	if (rq->rt.bitmap) {
+		__asm__("bsrl %1,%0":"=r" (level):"r" (rq->rt.bitmap));
+		next = rq->rt.queue[level];
+	} else if (rq->active->bitmap) {
+		__asm__("bsrl %1,%0":"=r" (level):"r" (rq->active->bitmap));
+		next = rq->active->queue[level];
+	} else
+		next = rq->idle;
+	if (next != prev)
+		account_switch(prev, next);
+	spin_unlock(&rq->lock);
+/*
+ * On SMP we may come back on another CPU, and the fpu state has to be
+ * in the TSS by then: save it now, and let the next use trap and load
+ * it. This also means last_task_used_math can't be us after the switch.
+ */
+	if (smp_num_cpus > 1 && next != prev &&
+	    last_task_used_math_set[cpu] == prev) {
+		__asm__("fwait ; fnsave %0"::"m" (prev->tss.i387));
+		last_task_used_math_set[cpu] = NULL;
+	}
+	prev->lock_depth = kernel_counter;
+	if (next != prev) {
+		pair = tss_pair[cpu] ^ 1;
+		set_tss_desc(gdt+(pair<<1)+FIRST_TSS_ENTRY,&(next->tss));
+		set_ldt_desc(gdt+(pair<<1)+FIRST_LDT_ENTRY,&(next->ldt));
+		next->tss.ldt = _LDT(pair);
+		tss_pair[cpu] = pair;
+		switch_to(next,pair);
+	}
+	kernel_counter = prev->lock_depth;
+	restore_flags(flags);
 }
 
+/*
+ * A new task doesn't come back into schedule() the first time it runs:
+ * it starts at ret_from_fork (sys_call.s), which calls this to do what
+ * schedule() would have done, and then drops the kernel lock.
+ */
+void schedule_tail(void)
+{
+	kernel_counter = current->lock_depth;
+	unlock_kernel();
+}
+
+static void cpu_idle(void);
+
+/*
+ * Task 0 pauses all the time: it only gets here when there was nothing
+ * else to run, so once schedule() has had a look it halts until the
+ * next interrupt.
+ */
 int sys_pause(void)
 {
+	if (current == &init_task.task) {
+		schedule();
+		cpu_idle();
+		return 0;
+	}
 	current->state = TASK_INTERRUPTIBLE;
 	schedule();
 	return 0;
 }
 
+struct wait_queue_stats wq_stats = {0, 0, 0};
+
+static spinlock_t waitqueue_lock = SPIN_LOCK_UNLOCKED;
+
+/*
+ * These can be called from interrupts, so they save and restore the
+ * interrupt flag rather than just doing cli/sti.
+ */
+void add_wait_queue(struct wait_queue ** p, struct wait_queue * wait)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&waitqueue_lock, flags);
+	if (!*p) {
+		wait->next = wait;
+		*p = wait;
+	} else {
+		wait->next = (*p)->next;
+		(*p)->next = wait;
+		if (wait->flags & WQ_FLAG_EXCLUSIVE)
+			*p = wait;
+	}
+	spin_unlock_irqrestore(&waitqueue_lock, flags);
+}
+
+void remove_wait_queue(struct wait_queue ** p, struct wait_queue * wait)
+{
+	unsigned long flags;
+	struct wait_queue * tmp;
+
+	spin_lock_irqsave(&waitqueue_lock, flags);
+	if (!(tmp = *p)) {
+		spin_unlock_irqrestore(&waitqueue_lock, flags);
+		printk("remove_wait_queue: empty queue\n\r");
+		return;
+	}
+	while (tmp->next != wait) {
+		tmp = tmp->next;
+		if (tmp == *p) {
+			spin_unlock_irqrestore(&waitqueue_lock, flags);
+			printk("remove_wait_queue: entry not found\n\r");
+			return;
+		}
+	}
+	if (tmp == wait)
+		*p = NULL;
+	else {
+		tmp->next = wait->next;
+		if (*p == wait)
+			*p = tmp;
+	}
+	wait->next = NULL;
+	spin_unlock_irqrestore(&waitqueue_lock, flags);
+}
+
 /*
 书上的表述是睡眠队列，但这里的“队列”并不是指数据结构中那个FIFO属性的队列，
 而指的是队伍、一堆任务的意思。
 源码是用栈的形式来管理这些睡眠任务的，所以p是指向栈顶的任务指针的指针。
 */
-static inline void __sleep_on(struct task_struct **p, int state)
+/*
+ * The wait_queue entry lives on our stack for as long as we sleep.
+ * Callers usually check their condition with interrupts off, so the
+ * entry is added with them still off: nobody can slip a wakeup in
+ * between. schedule() gives them back to whoever runs next.
+ */
+static inline void __sleep_on(struct wait_queue **p, int state, int flags)
 {
-	struct task_struct *tmp;
+	struct wait_queue wait;
 
 	if (!p)
 		return;
-	if (current == &(init_task.task))
-		panic("task[0] trying to sleep");
-	tmp = *p;  // 保存睡眠队列当前的首位任务指针
-	*p = current;
+	if (is_idle(current))
+		panic("idle task trying to sleep");
+	if (current->woken_from == p && current->woken_at == jiffies)
+		wq_stats.spurious++;
+	wait.task = current;
+	wait.flags = flags;
 	current->state = state;
-repeat:	schedule(); // schedule()中只唤醒可中断的任务，其实就是让任务的state等于0
-	/* 暂时不知道什么会导致出现 *p != current 的场景，但为了能唤醒整个栈中的睡眠任务，
-	   确实需要保证从栈顶的睡眠任务开始进行递归的唤醒回溯，所以是            (**)p.state=0 */
-	if (*p && *p != current) {
-		(**p).state = 0;	  
-		current->state = TASK_UNINTERRUPTIBLE;
-		goto repeat;
-	}
-	if (!*p)
-		printk("Warning: *P = NULL\n\r");
-	/* 唤醒比它早一步入栈的任务，递归回溯的结果是整个栈中的睡眠任务都被唤醒 */
-	if (*p = tmp)      
-		tmp->state=0;
+	add_wait_queue(p, &wait);
+	schedule();
+	remove_wait_queue(p, &wait);
+	current->woken_from = p;
+	current->woken_at = jiffies;
 }
 
 /* 将当前任务置为可中断的等待状态，并放入 *p 指定的等待队列中 */
-void interruptible_sleep_on(struct task_struct **p)
+void interruptible_sleep_on(struct wait_queue **p)
 {
-	__sleep_on(p,TASK_INTERRUPTIBLE);
+	__sleep_on(p,TASK_INTERRUPTIBLE,0);
+}
+
+/*
+ * Sleep for at most 'timeout' ticks. Returns the ticks that were left,
+ * 0 if we timed out.
+ */
+long interruptible_sleep_on_timeout(struct wait_queue **p, long timeout)
+{
+	long left;
+
+	current->timeout = jiffies + timeout;
+	__sleep_on(p,TASK_INTERRUPTIBLE,0);
+	left = current->timeout ? current->timeout - jiffies : 0;
+	current->timeout = 0;
+	return left > 0 ? left : 0;
 }
 
 /*
@@ -215,20 +728,65 @@ void interruptible_sleep_on(struct task_struct **p)
  * 只有明确地唤醒时才会返回。该函数提供了进程与中断处理程序之间的同步机制。
  * 函数参数 *p 是放置等待任务的队列头指针
  */
-void sleep_on(struct task_struct **p)
+void sleep_on(struct wait_queue **p)
+{
+	__sleep_on(p,TASK_UNINTERRUPTIBLE,0);
+}
+
+/*
+ * For sleepers that all want the same resource, and take it when they
+ * get it: only one of them is woken at a time.
+ */
+void sleep_on_exclusive(struct wait_queue **p)
 {
-	__sleep_on(p,TASK_UNINTERRUPTIBLE);
+	__sleep_on(p,TASK_UNINTERRUPTIBLE,WQ_FLAG_EXCLUSIVE);
 }
 
-void wake_up(struct task_struct **p)
+/*
+ * Wake up the non-exclusive sleepers on the queue, and 'nr_exclusive'
+ * of the exclusive ones (all of them if it is 0). Tasks that are on the
+ * queue but already running don't count: they have been woken, and just
+ * haven't got round to taking themselves off it.
+ */
+static void __wake_up(struct wait_queue **p, int nr_exclusive)
 {
-	if (p && *p) {
-		if ((**p).state == TASK_STOPPED)
+	struct wait_queue * tmp, * first;
+	struct task_struct * task;
+	unsigned long flags;
+	int woken_exclusive = 0;
+
+	if (!p || !*p)
+		return;
+	spin_lock_irqsave(&waitqueue_lock, flags);
+	tmp = first = (*p)->next;
+	do {
+		if ((task = tmp->task) == NULL || task->state == TASK_RUNNING)
+			continue;
+		if ((tmp->flags & WQ_FLAG_EXCLUSIVE) && nr_exclusive) {
+			if (woken_exclusive >= nr_exclusive) {
+				wq_stats.exclusive_skipped++;
+				continue;
+			}
+			woken_exclusive++;
+		}
+		if (task->state == TASK_STOPPED)
 			printk("wake_up: TASK_STOPPED");
-		if ((**p).state == TASK_ZOMBIE)
+		if (task->state == TASK_ZOMBIE)
 			printk("wake_up: TASK_ZOMBIE");
-		(**p).state=0;
-	}
+		wake_up_process(task);
+		wq_stats.wakeups++;
+	} while ((tmp = tmp->next) != first);
+	spin_unlock_irqrestore(&waitqueue_lock, flags);
+}
+
+void wake_up(struct wait_queue **p)
+{
+	__wake_up(p,1);
+}
+
+void wake_up_all(struct wait_queue **p)
+{
+	__wake_up(p,0);
 }
 
 /*
@@ -236,20 +794,34 @@ void wake_up(struct task_struct **p)
  * proper. They are here because the floppy needs a timer, and this
  * was the easiest way of doing it.
  */
-static struct task_struct * wait_motor[4] = {NULL,NULL,NULL,NULL};
-static int  mon_timer[4]={0,0,0,0};
-static int moff_timer[4]={0,0,0,0};
+static struct wait_queue * wait_motor[4] = {NULL,NULL,NULL,NULL};
+static unsigned long mon_time[4]={0,0,0,0};	/* when the motor is up to speed */
+static struct timer_list motor_on_timer[4];
+static struct timer_list motor_off_timer[4];
 unsigned char current_DOR = 0x0C;
 
+static void motor_on_callback(unsigned long nr)
+{
+	wake_up(nr+wait_motor);
+}
+
+static void motor_off_callback(unsigned long nr)
+{
+	current_DOR &= ~(0x10 << nr);
+	outb(current_DOR,FD_DOR);
+}
+
 int ticks_to_floppy_on(unsigned int nr)
 {
 	extern unsigned char selected;
 	unsigned char mask = 0x10 << nr;
+	long ticks;
 
 	if (nr>3)
 		panic("floppy_on: nr>3");
-	moff_timer[nr]=10000;		/* 100 s = very big :-) */
 	cli();				/* use floppy_off to turn it off */
+	motor_off_timer[nr].expires = jiffies + 100*HZ;	/* 100 s = very big :-) */
+	add_timer(motor_off_timer + nr);
 	mask |= current_DOR;
 	if (!selected) {
 		mask &= 0xFC;
@@ -258,13 +830,16 @@ int ticks_to_floppy_on(unsigned int nr)
 	if (mask != current_DOR) {
 		outb(mask,FD_DOR);
 		if ((mask ^ current_DOR) & 0xf0)
-			mon_timer[nr] = HZ/2;
-		else if (mon_timer[nr] < 2)
-			mon_timer[nr] = 2;
+			mon_time[nr] = jiffies + HZ/2;
+		else if ((long) (mon_time[nr] - jiffies) < 2)
+			mon_time[nr] = jiffies + 2;
 		current_DOR = mask;
+		motor_on_timer[nr].expires = mon_time[nr];
+		add_timer(motor_on_timer + nr);
 	}
+	ticks = mon_time[nr] - jiffies;
 	sti();
-	return mon_timer[nr];
+	return ticks > 0 ? ticks : 0;
 }
 
 void floppy_on(unsigned int nr)
@@ -277,117 +852,389 @@ void floppy_on(unsigned int nr)
 
 void floppy_off(unsigned int nr)
 {
-	moff_timer[nr]=3*HZ;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	motor_off_timer[nr].expires = jiffies + 3*HZ;
+	add_timer(motor_off_timer + nr);
+	restore_flags(flags);
+}
+
+/*
+ * The timer wheel. Timers due in the next 256 ticks hang off tv1, one
+ * list per tick. The ones further out go into tv2..tv5, each of which
+ * covers 64 times the range of the level below it, with one list per
+ * slot. Every time tv1 wraps around, the next slot of tv2 is emptied
+ * back into the wheel (and so on upwards when tv2 wraps), so a timer
+ * is moved at most four times before it runs. Adding and deleting are
+ * just list operations; nothing ever walks all the pending timers.
+ *
+ * 'timer_jiffies' is the tick the wheel has been run up to. It only
+ * lags behind jiffies while run_timer_list() catches up.
+ */
+#define TVN_BITS 6
+#define TVR_BITS 8
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVR_MASK (TVR_SIZE - 1)
+
+struct timer_vec {
+	int index;
+	struct timer_list * vec[TVN_SIZE];
+};
+
+struct timer_vec_root {
+	int index;
+	struct timer_list * vec[TVR_SIZE];
+};
+
+static struct timer_vec tv5;
+static struct timer_vec tv4;
+static struct timer_vec tv3;
+static struct timer_vec tv2;
+static struct timer_vec_root tv1;
+
+static struct timer_vec * const tvecs[] = {
+	(struct timer_vec *) &tv1, &tv2, &tv3, &tv4, &tv5
+};
+
+#define NOOF_TVECS (sizeof(tvecs) / sizeof(tvecs[0]))
+
+static unsigned long timer_jiffies = 0;
+
+static spinlock_t timer_lock = SPIN_LOCK_UNLOCKED;
+
+/* these must be called with the timer lock held */
+static inline void insert_timer(struct timer_list * timer,
+	struct timer_list ** vec)
+{
+	if ((timer->next = *vec) != NULL)
+		(*vec)->pprev = &timer->next;
+	*vec = timer;
+	timer->pprev = vec;
 }
 
-void do_floppy_timer(void)
+static inline void detach_timer(struct timer_list * timer)
 {
-	int i;
-	unsigned char mask = 0x10;
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+	*timer->pprev = timer->next;
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
 
-	for (i=0 ; i<4 ; i++,mask <<= 1) {
-		if (!(mask & current_DOR))
-			continue;
-		if (mon_timer[i]) {
-			if (!--mon_timer[i])
-				wake_up(i+wait_motor);
-		} else if (!moff_timer[i]) {
-			current_DOR &= ~mask;
-			outb(current_DOR,FD_DOR);
-		} else
-			moff_timer[i]--;
+static void internal_add_timer(struct timer_list * timer)
+{
+	unsigned long expires = timer->expires;
+	unsigned long idx = expires - timer_jiffies;
+	struct timer_list ** vec;
+
+	if (idx < TVR_SIZE)
+		vec = tv1.vec + (expires & TVR_MASK);
+	else if (idx < 1 << (TVR_BITS + TVN_BITS))
+		vec = tv2.vec + ((expires >> TVR_BITS) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 2*TVN_BITS))
+		vec = tv3.vec + ((expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 3*TVN_BITS))
+		vec = tv4.vec + ((expires >> (TVR_BITS + 2*TVN_BITS)) & TVN_MASK);
+	else if ((long) idx < 0)
+		/* already due: run it on the next tick */
+		vec = tv1.vec + tv1.index;
+	else
+		vec = tv5.vec + ((expires >> (TVR_BITS + 3*TVN_BITS)) & TVN_MASK);
+	insert_timer(timer, vec);
+}
+
+void add_timer(struct timer_list * timer)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&timer_lock, flags);
+	if (timer->pprev)
+		detach_timer(timer);
+	internal_add_timer(timer);
+	spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/* returns 1 if the timer was still pending */
+int del_timer(struct timer_list * timer)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&timer_lock, flags);
+	if (timer->pprev) {
+		detach_timer(timer);
+		ret = 1;
+	}
+	spin_unlock_irqrestore(&timer_lock, flags);
+	return ret;
+}
+
+/* empty the current slot of 'tv' back into the (lower levels of the) wheel */
+static inline void cascade_timers(struct timer_vec * tv)
+{
+	struct timer_list * timer, * next;
+
+	timer = tv->vec[tv->index];
+	tv->vec[tv->index] = NULL;
+	while (timer) {
+		next = timer->next;
+		internal_add_timer(timer);
+		timer = next;
+	}
+	tv->index = (tv->index + 1) & TVN_MASK;
+}
+
+/*
+ * Run everything that is due. Called from the timer interrupt, with
+ * interrupts off. The functions may add (or re-add) timers, so the lock
+ * is dropped while they run.
+ */
+void run_timer_list(void)
+{
+	struct timer_list * timer;
+	int n;
+
+	spin_lock(&timer_lock);
+	while ((long) (jiffies - timer_jiffies) >= 0) {
+		if (!tv1.index) {
+			n = 1;
+			do {
+				cascade_timers(tvecs[n]);
+			} while (tvecs[n]->index == 1 && ++n < NOOF_TVECS);
+		}
+		while ((timer = tv1.vec[tv1.index]) != NULL) {
+			detach_timer(timer);
+			spin_unlock(&timer_lock);
+			timer->function(timer->data);
+			spin_lock(&timer_lock);
+		}
+		++timer_jiffies;
+		tv1.index = (tv1.index + 1) & TVR_MASK;
 	}
+	spin_unlock(&timer_lock);
+}
+
+/*
+ * The per-process timers. 'timeout' is still what the sleeper looks at
+ * (and may clear itself), the timer only does the waking up.
+ */
+void process_timeout(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	if (p->timeout && p->timeout <= jiffies) {
+		p->timeout = 0;
+		if (p->state == TASK_INTERRUPTIBLE)
+			wake_up_process(p);
+	}
+}
+
+void process_alarm(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	p->alarm = 0;
+	p->signal |= (1<<(SIGALRM-1));
+	signal_wake_up(p);
 }
 
-#define TIME_REQUESTS 64	// 最多可以有64个定时器链表
+/*
+ * Tickless idle. With 'tickless' set, the idle task doesn't halt with
+ * the timer interrupting it every tick: it first puts the 8253 in one-
+ * shot mode (mode 0), counting down to the tick the next timer is due
+ * on. The 8253 counts at 1.19MHz into 16 bits, so that's at most
+ * MAX_IDLE_TICKS ticks away. 'idle_ticks' is the number of ticks the
+ * one-shot covers: the timer interrupt ending it adds them to jiffies
+ * (the interrupt itself only counts one) and goes back to periodic
+ * mode. If some other interrupt wakes us up first, cpu_idle() counts
+ * the whole ticks that went by, and lets the 8253 run to the end of
+ * the current one, so that no time is lost.
+ */
+#define MAX_IDLE_TICKS (0xffff / LATCH)
 
-static struct timer_list {
-	long jiffies;
-	void (*fn)();
-	struct timer_list * next;
-} timer_list[TIME_REQUESTS], * next_timer = NULL;
+int tickless = 0;
+static unsigned long idle_ticks = 0;
 
-// 添加定时器，输入参数为指定的定时值（滴答数）和相应的处理程序指针
-void add_timer(long jiffies, void (*fn)(void))
+static inline void set_periodic_timer(void)
 {
-	struct timer_list * p;
+	outb_p(0x36,0x43);		/* binary, mode 3, LSB/MSB, ch 0 */
+	outb_p(LATCH & 0xff , 0x40);	/* LSB */
+	outb(LATCH >> 8 , 0x40);	/* MSB */
+}
+
+static inline void set_oneshot_timer(unsigned long count)
+{
+	outb_p(0x30,0x43);		/* binary, mode 0, LSB/MSB, ch 0 */
+	outb_p(count & 0xff , 0x40);	/* LSB */
+	outb(count >> 8 , 0x40);	/* MSB */
+}
 
-	if (!fn)
+static inline unsigned long read_timer_count(void)
+{
+	unsigned long count;
+
+	outb_p(0x00,0x43);		/* latch ch 0 */
+	count = inb_p(0x40);
+	count |= inb(0x40) << 8;
+	return count;
+}
+
+/* is the timer interrupt waiting for us to sti? */
+static inline int timer_irq_pending(void)
+{
+	outb_p(0x0a,0x20);		/* OCW3: read IRR */
+	return inb(0x20) & 1;
+}
+
+/*
+ * How many ticks we can sleep: up to the first non-empty slot of tv1,
+ * or the tick tv1 wraps on (the cascade may bring timers down that are
+ * due right away). Only valid when the wheel is up to date.
+ */
+static unsigned long idle_timer_ticks(unsigned long max)
+{
+	unsigned long n;
+	int idx = tv1.index;
+
+	for (n = 1 ; n < max ; n++) {
+		if (tv1.vec[idx] || !idx)
+			break;
+		idx = (idx + 1) & TVR_MASK;
+	}
+	return n;
+}
+
+/*
+ * The kernel lock is let go of while we halt, so the other CPUs can
+ * get on with it (and wake tasks up for us: they send an IPI to get us
+ * out of the hlt). Only the boot CPU ever idles tickless.
+ */
+static void cpu_idle(void)
+{
+	struct runqueue * rq;
+	unsigned long ticks, total, left;
+	int depth;
+
+	if (zero_idle_page())	/* something better to do than halt */
 		return;
 	cli();
-	if (jiffies <= 0)
-		(fn)();
-	else {
-		for (p = timer_list ; p < timer_list + TIME_REQUESTS ; p++)
-			if (!p->fn)
-				break;
-		if (p >= timer_list + TIME_REQUESTS)
-			panic("No more time requests free");
-		p->fn = fn;
-		p->jiffies = jiffies;
-		p->next = next_timer;
-		next_timer = p;
-		while (p->next && p->next->jiffies < p->jiffies) {
-			p->jiffies -= p->next->jiffies;
-			fn = p->fn;
-			p->fn = p->next->fn;
-			p->next->fn = fn;
-			jiffies = p->jiffies;
-			p->jiffies = p->next->jiffies;
-			p->next->jiffies = jiffies;
-			p = p->next;
+	rq = cpu_rq(smp_processor_id());
+	if (rq_nr_running(rq)) {	/* real-time ones too */
+		sti();
+		return;
+	}
+	depth = release_kernel_lock();
+	if (tickless && !idle_ticks && timer_jiffies == jiffies+1) {
+		ticks = MAX_IDLE_TICKS;
+		if (beepcount && beepcount < ticks)
+			ticks = beepcount;
+		ticks = idle_timer_ticks(ticks);
+		if (ticks > 1) {
+			set_oneshot_timer(ticks * LATCH);
+			idle_ticks = ticks;
+		}
+	}
+	__asm__("sti ; hlt ; cli");
+	if (idle_ticks && !timer_irq_pending()) {
+		total = idle_ticks * LATCH;
+		left = read_timer_count();
+		if (left && left <= total) {
+			ticks = (total - left) / LATCH;
+			jiffies += ticks;
+			set_oneshot_timer(left - (idle_ticks - ticks - 1) * LATCH);
+			idle_ticks = 1;
 		}
 	}
+	reacquire_kernel_lock(depth);
 	sti();
 }
 
+/*
+ * The idle task of the other CPUs has no user mode to pause() from: it
+ * just does what task 0 does on every pause().
+ */
+void smp_idle(void)
+{
+	lock_kernel();
+	for (;;) {
+		schedule();
+		cpu_idle();
+	}
+}
+
+/*
+ * The time-slice part of the timer interrupts. SCHED_FIFO tasks don't
+ * have a slice: they run until they block or yield, or something with a
+ * higher priority comes along.
+ */
+static void update_slice(struct task_struct * p, long cpl)
+{
+	if (p->policy != SCHED_FIFO && (--p->counter) <= 0)
+		p->counter=0;
+	if (!cpl) return;  // 对于内核态程序，不依赖 counter 值进行调度
+	if (!p->counter || need_resched[smp_processor_id()])
+		schedule();
+}
+
 // 时钟中断 C 函数处理程序，在 kernel/system_call.s 中的 _timer_interrupt 被
 // 调用。参数 cpl 是当前特权级 0 或 3，0 表示在内核代码在执行
 // 对于一个进程由于执行时间片用完时，则进行任务切换，并执行一个计时更新工作
 void do_timer(long cpl)
 {
 	static int blanked = 0;
+	long ticks = 1;
 
+	if (idle_ticks) {	/* end of a tickless idle period */
+		ticks = idle_ticks;
+		jiffies += ticks-1;
+		idle_ticks = 0;
+		set_periodic_timer();
+	}
 	if (blankcount || !blankinterval) {
 		if (blanked)
 			unblank_screen();
 		if (blankcount)
-			blankcount--;
+			blankcount = (blankcount > ticks) ? blankcount-ticks : 0;
 		blanked = 0;
 	} else if (!blanked) {
 		blank_screen();
 		blanked = 1;
 	}
-	if (hd_timeout)
-		if (!--hd_timeout)
-			hd_times_out();
-
 	if (beepcount)
-		if (!--beepcount)
+		if ((beepcount -= ticks) <= 0) {
+			beepcount = 0;
 			sysbeepstop();
+		}
 
 	if (cpl)
-		current->utime++;
+		current->utime += ticks;
 	else
-		current->stime++;
-
-	if (next_timer) {
-		next_timer->jiffies--;
-		while (next_timer && next_timer->jiffies <= 0) {
-			void (*fn)(void);
-			
-			fn = next_timer->fn;
-			next_timer->fn = NULL;
-			next_timer = next_timer->next;
-			(fn)();
-		}
-	}
-	if (current_DOR & 0xf0)
-		do_floppy_timer();
-	if ((--current->counter)>0) return;  // 如果进程运行时间还没完，则退出
-	current->counter=0;
-	if (!cpl) return;  // 对于内核态程序，不依赖 counter 值进行调度
-	schedule();
+		current->stime += ticks;
+
+	run_timer_list();
+	rebalance_tick();
+	update_slice(current,cpl);
+}
+
+/*
+ * The local APIC timer of the other CPUs. jiffies and the timers are
+ * all looked after by do_timer() on the boot CPU: this only does the
+ * accounting and time-slices of the tasks this CPU runs.
+ */
+void smp_local_timer(long cpl)
+{
+	struct task_struct * p = current;
+
+	if (cpl)
+		p->utime++;
+	else
+		p->stime++;
+	rebalance_tick();
+	update_slice(p,cpl);
 }
 
 // 设置报警定时时间值（秒）
@@ -398,6 +1245,11 @@ int sys_alarm(long seconds)
 	if (old)
 		old = (old - jiffies) / HZ;
 	current->alarm = (seconds>0)?(jiffies+HZ*seconds):0;
+	if (current->alarm) {
+		current->alarm_timer.expires = current->alarm;
+		add_timer(&current->alarm_timer);
+	} else
+		del_timer(&current->alarm_timer);
 	return (old);
 }
 
@@ -438,6 +1290,124 @@ int sys_nice(long increment)
 	return 0;
 }
 
+/*
+ * Changing the policy of a task means moving it to another array, so
+ * it's done with its run queue locked. Only root can make a task
+ * real-time, and only the owner (or root) can change it at all.
+ */
+int sys_sched_setscheduler(int pid, int policy, struct sched_param * param)
+{
+	struct task_struct * p;
+	struct runqueue * rq;
+	unsigned long flags;
+	long prio;
+
+	if (!param)
+		return -EINVAL;
+	prio = get_fs_long((unsigned long *) &param->sched_priority);
+	if (policy == SCHED_OTHER) {
+		if (prio)
+			return -EINVAL;
+	} else if (policy == SCHED_FIFO || policy == SCHED_RR) {
+		if (prio < SCHED_PRIO_MIN || prio > SCHED_PRIO_MAX)
+			return -EINVAL;
+	} else
+		return -EINVAL;
+	if (pid < 0)
+		return -EINVAL;
+	if (!(p = pid ? find_task_by_pid(pid) : current))
+		return -ESRCH;
+	if (current->euid != p->euid && current->euid != p->uid && !suser())
+		return -EPERM;
+	if (policy != SCHED_OTHER && !suser())
+		return -EPERM;
+	rq = cpu_rq(p->processor);
+	spin_lock_irqsave(&rq->lock, flags);
+	if (p->array) {
+		dequeue_task(p);
+		p->policy = policy;
+		p->rt_priority = prio;
+		if (p->counter <= 0)
+			p->counter = p->priority;
+		activate_task(p, rq);
+		check_preempt(p, p->processor);
+	} else {
+		p->policy = policy;
+		p->rt_priority = prio;
+	}
+	spin_unlock_irqrestore(&rq->lock, flags);
+/* we may have just made ourselves less important than somebody */
+	need_resched[smp_processor_id()] = 1;
+	return 0;
+}
+
+int sys_sched_getscheduler(int pid)
+{
+	struct task_struct * p;
+
+	if (pid < 0)
+		return -EINVAL;
+	if (!(p = pid ? find_task_by_pid(pid) : current))
+		return -ESRCH;
+	return p->policy;
+}
+
+/*
+ * A real-time task goes to the back of its level. A time-sharing one
+ * goes behind the others with the same counter anyway when schedule()
+ * puts it back on the queue.
+ */
+int sys_sched_yield(void)
+{
+	struct runqueue * rq = cpu_rq(current->processor);
+	unsigned long flags;
+
+	spin_lock_irqsave(&rq->lock, flags);
+	if (rt_task(current) && current->array == &rq->rt) {
+		dequeue_task(current);
+		enqueue_task(current, &rq->rt);
+	}
+	spin_unlock_irqrestore(&rq->lock, flags);
+	schedule();
+	return 0;
+}
+
+/*
+ * Copy out the statistics of 'pid' (0 for ourselves) and the global
+ * ones. Either pointer may be NULL. Anybody may look at anybody: this
+ * is for tools like top, and tells no more than ps does.
+ */
+int sys_sched_getstats(int pid, struct sched_task_stats * task,
+	struct sched_stats * stats)
+{
+	struct task_struct * p;
+	struct sched_stats s;
+	unsigned long * from, * to;
+	int i;
+
+	if (pid < 0)
+		return -EINVAL;
+	if (!(p = pid ? find_task_by_pid(pid) : current))
+		return -ESRCH;
+	if (task) {
+		verify_area(task, sizeof(*task));
+		from = (unsigned long *) &p->sched_info;
+		to = (unsigned long *) task;
+		for (i = 0 ; i < sizeof(*task)/4 ; i++)
+			put_fs_long(from[i], to+i);
+	}
+	if (stats) {
+		s = sched_stats;
+		s.nr_running = nr_running();
+		verify_area(stats, sizeof(*stats));
+		from = (unsigned long *) &s;
+		to = (unsigned long *) stats;
+		for (i = 0 ; i < sizeof(*stats)/4 ; i++)
+			put_fs_long(from[i], to+i);
+	}
+	return 0;
+}
+
 void sched_init(void)
 {
 	int i;
@@ -450,8 +1420,7 @@ void sched_init(void)
 	set_tss_desc(gdt+FIRST_TSS_ENTRY,&(init_task.task.tss));
 	set_ldt_desc(gdt+FIRST_LDT_ENTRY,&(init_task.task.ldt));
 	p = gdt+2+FIRST_TSS_ENTRY;
-	for(i=1;i<NR_TASKS;i++) {
-		task[i] = NULL;
+	for(i=1;i<2*NR_CPUS;i++) {
 		p->a=p->b=0;
 		p++;
 		p->a=p->b=0;
@@ -461,11 +1430,26 @@ void sched_init(void)
 	__asm__("pushfl ; andl $0xffffbfff,(%esp) ; popfl");
 	ltr(0);		// 将任务 0 的 TSS 段描述符地址加载到任务寄存器 tr
 	lldt(0);	// 将局部描述符表加载到局部描述符表寄存器
+	for (i=0 ; i<NR_CPUS ; i++) {
+		spin_lock_init(&cpu_rq(i)->lock);
+		cpu_rq(i)->active = cpu_rq(i)->arrays;
+		cpu_rq(i)->expired = cpu_rq(i)->arrays + 1;
+		cpu_rq(i)->balance_ticks = BALANCE_TICKS;
+	}
+	init_idle(&(init_task.task), 0);
+	has_tsc = check_tsc();
+	for (i=0 ; i<4 ; i++) {
+		init_timer(motor_on_timer + i);
+		motor_on_timer[i].data = i;
+		motor_on_timer[i].function = motor_on_callback;
+		init_timer(motor_off_timer + i);
+		motor_off_timer[i].data = i;
+		motor_off_timer[i].function = motor_off_callback;
+	}
 	
 	// 初始化 8253 定时器
-	outb_p(0x36,0x43);		/* binary, mode 3, LSB/MSB, ch 0 */
-	outb_p(LATCH & 0xff , 0x40);	/* LSB */
-	outb(LATCH >> 8 , 0x40);	/* MSB */
+	set_periodic_timer();
+	tickless = TICKLESS_IDLE;
 	
 	set_intr_gate(0x20,&timer_interrupt);  // 设置时钟中断处理程序句柄
 	outb(inb_p(0x21)&~0x01,0x21);  // 修改中断控制器屏蔽码，允许时钟中断
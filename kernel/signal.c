@@ -176,8 +176,10 @@ int do_signal(long signr,long eax,long ebx, long ecx, long edx, long orig_eax,
 			current->state = TASK_STOPPED;
 			current->exit_code = signr;
 			if (!(current->p_pptr->sigaction[SIGCHLD-1].sa_flags & 
-					SA_NOCLDSTOP))
+					SA_NOCLDSTOP)) {
 				current->p_pptr->signal |= (1<<(SIGCHLD-1));
+				signal_wake_up(current->p_pptr);
+			}
 			return(1);  /* Reschedule another event */
 
 		case SIGQUIT:
@@ -0,0 +1,449 @@
+/*
+ *  linux/kernel/smp.c
+ */
+
+/*
+ * Bringing up the other CPUs of a multiprocessor. We find them in the
+ * Intel MP table the BIOS leaves us, enable the local APIC of the boot
+ * CPU, and wake up the others one at a time with INIT and STARTUP IPIs.
+ * Each gets an idle task of its own, and a local APIC timer to do its
+ * scheduling from. Device interrupts all still go to the boot CPU,
+ * through the 8259 in virtual wire mode: the IO-APIC is only reported.
+ *
+ * None of this is needed on a uniprocessor. If there is no MP table,
+ * smp_init() returns without touching anything, and all the per-CPU
+ * stuff is just that of CPU 0.
+ */
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/head.h>
+#include <asm/system.h>
+#include <asm/io.h>
+#include <string.h>
+
+#define LATCH (1193180/HZ)
+
+#define TRAMPOLINE_ADDR	0x90000		/* gets overwritten by buffer_init() */
+
+/* "_MP_", the MP floating pointer structure */
+#define SMP_MAGIC_IDENT	(('_'<<24)|('P'<<16)|('M'<<8)|'_')
+
+struct intel_mp_floating {
+	char mpf_signature[4];
+	unsigned long mpf_physptr;	/* the configuration table */
+	unsigned char mpf_length;	/* in 16-byte units, always 1 */
+	unsigned char mpf_specification;
+	unsigned char mpf_checksum;
+	unsigned char mpf_feature1;	/* default configuration if non-zero */
+	unsigned char mpf_feature2;
+	unsigned char mpf_feature3[3];
+};
+
+struct mp_config_table {
+	char mpc_signature[4];		/* "PCMP" */
+	unsigned short mpc_length;
+	char mpc_spec;
+	char mpc_checksum;
+	char mpc_oem[8];
+	char mpc_productid[12];
+	unsigned long mpc_oemptr;
+	unsigned short mpc_oemsize;
+	unsigned short mpc_oemcount;
+	unsigned long mpc_lapic;
+	unsigned long mpc_reserved;
+};
+
+#define MP_PROCESSOR	0
+#define MP_BUS		1
+#define MP_IOAPIC	2
+#define MP_INTSRC	3
+#define MP_LINTSRC	4
+
+struct mpc_config_processor {
+	unsigned char mpc_type;
+	unsigned char mpc_apicid;
+	unsigned char mpc_apicver;
+	unsigned char mpc_cpuflag;
+	unsigned long mpc_cpufeature;
+	unsigned long mpc_featureflag;
+	unsigned long mpc_reserved[2];
+};
+
+#define CPU_ENABLED		1
+#define CPU_BOOTPROCESSOR	2
+
+struct mpc_config_ioapic {
+	unsigned char mpc_type;
+	unsigned char mpc_apicid;
+	unsigned char mpc_apicver;
+	unsigned char mpc_flags;
+	unsigned long mpc_apicaddr;
+};
+
+int smp_num_cpus = 1;
+unsigned char apicid_to_cpu[256] = {0, };
+static unsigned char cpu_to_apicid[NR_CPUS] = {0, };
+
+static unsigned long apic_phys = 0;
+static unsigned long io_apic_phys = 0;
+static unsigned char mp_apicids[NR_CPUS];
+static int mp_nr_cpus = 0;
+
+static unsigned long apic_timer_count = 0;	/* local APIC ticks per jiffy */
+static volatile unsigned long cpu_callin_map = 1;
+static volatile int smp_commenced = 0;
+
+/* for trampoline.s */
+unsigned long ap_cr0 = 0;
+struct {
+	long * a;
+	short b;
+	} ap_stack = { NULL, 0x10 };
+
+extern char trampoline[], trampoline_end[];
+extern void apic_timer_interrupt(void);
+extern void reschedule_interrupt(void);
+extern int tickless;
+
+/*
+ * The kernel lock. 'kernel_counter' is the nesting depth of whoever
+ * holds it, so it only means something to the owner. Interrupts are
+ * kept off while we change hands, or an interrupt coming in between
+ * would find us owning the lock with a depth of 0.
+ */
+static spinlock_t kernel_flag = SPIN_LOCK_UNLOCKED;
+static volatile int kernel_owner = NO_PROC_ID;
+int kernel_counter = 0;
+
+void lock_kernel(void)
+{
+	unsigned long flags;
+	int cpu;
+
+	save_flags(flags);
+	cli();
+	cpu = smp_processor_id();
+	if (kernel_owner != cpu) {
+		spin_lock(&kernel_flag);
+		kernel_owner = cpu;
+	}
+	kernel_counter++;
+	restore_flags(flags);
+}
+
+void unlock_kernel(void)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (!--kernel_counter) {
+		kernel_owner = NO_PROC_ID;
+		spin_unlock(&kernel_flag);
+	}
+	restore_flags(flags);
+}
+
+/*
+ * Let go of the lock completely, to halt. Called with interrupts off,
+ * returns the depth reacquire_kernel_lock() has to restore.
+ */
+int release_kernel_lock(void)
+{
+	int depth = kernel_counter;
+
+	if (depth) {
+		kernel_counter = 1;
+		unlock_kernel();
+	}
+	return depth;
+}
+
+void reacquire_kernel_lock(int depth)
+{
+	if (depth) {
+		lock_kernel();
+		kernel_counter = depth;
+	}
+}
+
+static int mpf_checksum(unsigned char * mp, int len)
+{
+	int sum = 0;
+
+	while (len--)
+		sum += *mp++;
+	return sum & 0xFF;
+}
+
+static struct intel_mp_floating * smp_scan(unsigned long base,
+	unsigned long length)
+{
+	unsigned long * bp = (unsigned long *) base;
+	struct intel_mp_floating * mpf;
+
+	for ( ; length > 0 ; bp += 4, length -= 16) {
+		if (*bp != SMP_MAGIC_IDENT)
+			continue;
+		mpf = (struct intel_mp_floating *) bp;
+		if (mpf->mpf_length == 1 && !mpf_checksum((unsigned char *) bp,16) &&
+		    (mpf->mpf_specification == 1 || mpf->mpf_specification == 4))
+			return mpf;
+	}
+	return NULL;
+}
+
+static int smp_read_mpc(struct mp_config_table * mpc)
+{
+	unsigned char * mpt = ((unsigned char *) mpc) + sizeof(*mpc);
+	int count = sizeof(*mpc);
+	struct mpc_config_processor * m;
+	struct mpc_config_ioapic * io;
+
+	if (memcmp(mpc->mpc_signature,"PCMP",4) ||
+	    mpf_checksum((unsigned char *) mpc, mpc->mpc_length)) {
+		printk("SMP: bad MP configuration table\n\r");
+		return 0;
+	}
+	apic_phys = mpc->mpc_lapic;
+	while (count < mpc->mpc_length) {
+		switch (*mpt) {
+			case MP_PROCESSOR:
+				m = (struct mpc_config_processor *) mpt;
+				if ((m->mpc_cpuflag & CPU_ENABLED) &&
+				    mp_nr_cpus < NR_CPUS)
+					mp_apicids[mp_nr_cpus++] = m->mpc_apicid;
+				mpt += sizeof(*m);
+				count += sizeof(*m);
+				break;
+			case MP_IOAPIC:
+				io = (struct mpc_config_ioapic *) mpt;
+				if (!io_apic_phys)
+					io_apic_phys = io->mpc_apicaddr;
+				mpt += sizeof(*io);
+				count += sizeof(*io);
+				break;
+			case MP_BUS:
+			case MP_INTSRC:
+			case MP_LINTSRC:
+				mpt += 8;
+				count += 8;
+				break;
+			default:
+				count = mpc->mpc_length;
+				break;
+		}
+	}
+	return mp_nr_cpus;
+}
+
+/*
+ * The floating pointer is in the last kB of base memory, or in the BIOS
+ * rom. It could also be in the EBDA, but the pointer to that was in the
+ * BIOS data area, and pg_dir is there now.
+ */
+static int smp_scan_config(void)
+{
+	struct intel_mp_floating * mpf;
+
+	if (!(mpf = smp_scan(0x9FC00,0x400)) &&
+	    !(mpf = smp_scan(0xF0000,0x10000)))
+		return 0;
+	if (mpf->mpf_feature1) {	/* one of the default configurations */
+		apic_phys = APIC_DEFAULT_PHYS_BASE;
+		io_apic_phys = IO_APIC_DEFAULT_PHYS_BASE;
+		mp_apicids[0] = 0;
+		mp_apicids[1] = 1;
+		return mp_nr_cpus = 2;
+	}
+	if (!mpf->mpf_physptr || mpf->mpf_physptr >= 0x1000000 - PAGE_SIZE) {
+		printk("SMP: MP configuration table out of reach\n\r");
+		return 0;
+	}
+	return smp_read_mpc((struct mp_config_table *) mpf->mpf_physptr);
+}
+
+/* map an APIC page at 'addr', uncached: see paging_init() */
+static void map_apic_page(unsigned long addr, unsigned long phys)
+{
+	unsigned long * pte;
+
+	pte = (unsigned long *) (pg_dir[addr >> 22] & 0xfffff000);
+	pte[(addr >> 12) & 0x3ff] = (phys & 0xfffff000) | 0x1b;
+	__asm__("movl %%eax,%%cr3"::"a" (0));
+}
+
+/* busy-wait 'count' cycles of the 8253 (1.19MHz), using channel 2 */
+static void pit_wait(unsigned long count)
+{
+	outb((inb(0x61) & ~0x02) | 0x01, 0x61);	/* gate on, speaker off */
+	outb(0xb0, 0x43);			/* ch 2, mode 0, LSB/MSB */
+	outb(count & 0xff, 0x42);
+	outb(count >> 8, 0x42);
+	while (!(inb(0x61) & 0x20))
+		/* nothing */;
+}
+
+/*
+ * Only the boot CPU listens to the 8259 (on LINT0) and to NMIs: the
+ * others just get their timer and our IPIs.
+ */
+static void setup_local_apic(int boot)
+{
+	apic_write(APIC_TPR, 0);
+	apic_write(APIC_SVR, (apic_read(APIC_SVR) & ~0xff) |
+		APIC_SVR_ENABLE | SPURIOUS_VECTOR);
+	if (boot) {
+		apic_write(APIC_LVT0, APIC_DM_EXTINT);
+		apic_write(APIC_LVT1, APIC_DM_NMI);
+	} else {
+		apic_write(APIC_LVT0, APIC_LVT_MASKED);
+		apic_write(APIC_LVT1, APIC_DM_NMI | APIC_LVT_MASKED);
+	}
+}
+
+static void calibrate_apic_timer(void)
+{
+	apic_write(APIC_TDCR, APIC_TDR_DIV_1);
+	apic_write(APIC_LVTT, APIC_LVT_MASKED | APIC_TIMER_VECTOR);
+	apic_write(APIC_TMICT, 0xffffffff);
+	pit_wait(LATCH);
+	apic_timer_count = 0xffffffff - apic_read(APIC_TMCCT);
+	apic_write(APIC_TMICT, 0);
+}
+
+static void setup_apic_timer(void)
+{
+	apic_write(APIC_TDCR, APIC_TDR_DIV_1);
+	apic_write(APIC_LVTT, APIC_LVT_PERIODIC | APIC_TIMER_VECTOR);
+	apic_write(APIC_TMICT, apic_timer_count);
+}
+
+static inline void apic_wait_icr_idle(void)
+{
+	while (apic_read(APIC_ICR) & APIC_ICR_BUSY)
+		/* nothing */;
+}
+
+static void send_ipi(int apicid, unsigned long cmd)
+{
+	apic_wait_icr_idle();
+	apic_write(APIC_ICR2, apicid << 24);
+	apic_write(APIC_ICR, cmd);
+}
+
+void smp_send_reschedule(int cpu)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	send_ipi(cpu_to_apicid[cpu], RESCHEDULE_VECTOR);
+	restore_flags(flags);
+}
+
+/*
+ * The other CPUs come here from trampoline.s, on the stack of their
+ * idle task, and wait for the boot CPU to finish setting up before they
+ * start scheduling.
+ */
+void start_secondary(void)
+{
+	int cpu = smp_processor_id();
+
+	setup_local_apic(0);
+	ltr(tss_pair[cpu]);
+	lldt(tss_pair[cpu]);
+	__asm__("pushfl ; andl $0xffffbfff,(%esp) ; popfl");
+	setup_apic_timer();
+	cpu_callin_map |= 1 << cpu;
+	while (!smp_commenced)
+		/* nothing */;
+	smp_idle();
+}
+
+/*
+ * The idle task of a new CPU is a copy of task 0, and starts out in the
+ * first descriptor pair of that CPU. It isn't on the task list.
+ */
+static int boot_secondary(int apicid, int cpu)
+{
+	struct task_struct * p;
+	int nr = cpu << 1;
+	int i;
+
+	if (!(p = (struct task_struct *) get_free_page()))
+		return 0;
+	*p = init_task.task;
+	p->state = TASK_RUNNING;
+	p->processor = cpu;
+	p->lock_depth = 0;
+	p->tss.esp0 = PAGE_SIZE + (long) p;
+	p->tss.ldt = _LDT(nr);
+	tss_pair[cpu] = nr;
+	set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
+	set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
+	init_idle(p, cpu);
+	apicid_to_cpu[apicid] = cpu;
+	cpu_to_apicid[cpu] = apicid;
+	ap_stack.a = (long *) (PAGE_SIZE + (long) p);
+
+	send_ipi(apicid, APIC_ICR_ASSERT | APIC_DM_INIT);
+	pit_wait(LATCH);			/* 10ms */
+	for (i = 0 ; i < 2 ; i++) {
+		send_ipi(apicid, APIC_DM_STARTUP | (TRAMPOLINE_ADDR >> 12));
+		pit_wait(1193180/5000);		/* 200us */
+	}
+	for (i = 0 ; i < HZ ; i++) {
+		if (cpu_callin_map & (1 << cpu))
+			return 1;
+		pit_wait(LATCH);
+	}
+	printk("SMP: CPU with APIC id %d didn't call in\n\r", apicid);
+	apicid_to_cpu[apicid] = 0;
+	init_idle(NULL, cpu);
+	free_page((long) p);
+	return 0;
+}
+
+/*
+ * Called after sched_init(), and before buffer_init() takes the
+ * trampoline page. Interrupts are still off.
+ */
+void smp_init(void)
+{
+	int i, boot_id;
+
+	if (!smp_scan_config())
+		return;
+	map_apic_page(APIC_BASE, apic_phys);
+	boot_id = apic_read(APIC_ID) >> 24;
+	cpu_to_apicid[0] = boot_id;
+	setup_local_apic(1);
+	if (io_apic_phys) {
+		map_apic_page(IO_APIC_BASE, io_apic_phys);
+		printk("IO-APIC: %d pins, left alone (interrupts go through the 8259)\n\r",
+			((io_apic_read(1) >> 16) & 0xff) + 1);
+	}
+	calibrate_apic_timer();
+	set_intr_gate(APIC_TIMER_VECTOR,&apic_timer_interrupt);
+	set_intr_gate(RESCHEDULE_VECTOR,&reschedule_interrupt);
+	memcpy((void *) TRAMPOLINE_ADDR, trampoline, trampoline_end - trampoline);
+	__asm__("movl %%cr0,%0":"=r" (ap_cr0));
+	for (i = 0 ; i < mp_nr_cpus && smp_num_cpus < NR_CPUS ; i++) {
+		if (mp_apicids[i] == boot_id)
+			continue;
+		if (boot_secondary(mp_apicids[i], smp_num_cpus))
+			smp_num_cpus++;
+	}
+	printk("SMP: %d CPUs, local APIC timer %d ticks/jiffy\n\r",
+		smp_num_cpus, apic_timer_count);
+	if (smp_num_cpus > 1)
+		tickless = 0;	/* the idle CPUs don't all stop the one 8253 */
+}
+
+/* let the other CPUs start scheduling */
+void smp_commence(void)
+{
+	smp_commenced = 1;
+}
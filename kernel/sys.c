@@ -250,7 +250,7 @@ int sys_brk(unsigned long end_data_seg)
  */
 int sys_setpgid(int pid, int pgid)
 {
-	int i; 
+	struct task_struct * p;
 
 	if (!pid)
 		pid = current->pid;
@@ -258,20 +258,17 @@ int sys_setpgid(int pid, int pgid)
 		pgid = current->pid;
 	if (pgid < 0)
 		return -EINVAL;
-	for (i=0 ; i<NR_TASKS ; i++)
-		if (task[i] && (task[i]->pid == pid) &&
-		    ((task[i]->p_pptr == current) || 
-		     (task[i] == current))) {
-			if (task[i]->leader)
-				return -EPERM;
-			if ((task[i]->session != current->session) ||
-			    ((pgid != pid) && 
-			     (session_of_pgrp(pgid) != current->session)))
-				return -EPERM;
-			task[i]->pgrp = pgid;
-			return 0;
-		}
-	return -ESRCH;
+	if (!(p = find_task_by_pid(pid)) ||
+	    ((p->p_pptr != current) && (p != current)))
+		return -ESRCH;
+	if (p->leader)
+		return -EPERM;
+	if ((p->session != current->session) ||
+	    ((pgid != pid) && 
+	     (session_of_pgrp(pgid) != current->session)))
+		return -EPERM;
+	set_pgrp(p, pgid);
+	return 0;
 }
 
 int sys_getpgrp(void)
@@ -284,7 +281,8 @@ int sys_setsid(void)
 	if (current->leader && !suser())
 		return -EPERM;
 	current->leader = 1;
-	current->session = current->pgrp = current->pid;
+	set_session(current, current->pid);
+	set_pgrp(current, current->pid);
 	current->tty = -1;
 	return current->pgrp;
 }
@@ -14,6 +14,10 @@
  * don't handle signal-recognition, as that would clutter them up totally
  * unnecessarily.
  *
+ * Everything that calls into C takes the kernel lock first, and drops
+ * it again just before the iret (see <linux/smp.h>). The current task
+ * is that of our CPU, found from the id of the local APIC.
+ *
  * Stack layout in 'ret_from_system_call':
  *
  *	 0(%esp) - %eax
@@ -64,15 +68,20 @@ sa_restorer = 12	# 恢复函数指针
 
 nr_system_calls = 82	# 内核中的系统调用总数
 
+APIC_BASE = 0x3FFFE000	# where the local APIC is mapped, see <asm/apic.h>
+APIC_ID	= APIC_BASE+0x20	# local APIC id register
+APIC_EOI = APIC_BASE+0xb0
+
 ENOSYS = 38
 
 /*
  * Ok, I get parallel printer interrupts while using the floppy for some
  * strange reason. Urgel. Now I just ignore them.
  */
-.globl _system_call,_sys_fork,_timer_interrupt,_sys_execve
+.globl _system_call,_sys_fork,_sys_vfork,_timer_interrupt,_sys_execve
 .globl _hd_interrupt,_floppy_interrupt,_parallel_interrupt
 .globl _device_not_available, _coprocessor_error
+.globl _ret_from_fork,_apic_timer_interrupt,_reschedule_interrupt
 
 .align 2		# 内存 4 字节对齐
 bad_sys_call:
@@ -96,12 +105,19 @@ _system_call:
 	mov %dx,%es
 	movl $0x17,%edx		# fs points to local data space
 	mov %dx,%fs
+	call _lock_kernel
+	movl 12(%esp),%eax		# orig_eax: the system call number
 	cmpl _NR_syscalls,%eax		# 发生系统调用时，系统调用号被存在 eax 中
 	jae bad_sys_call
 	call _sys_call_table(,%eax,4) 	# 调用地址 = _sys_call_table + %eax * 4
 	pushl %eax		# 把系统调用返回值入栈
 2:
-	movl _current,%eax		# 取当前任务（进程）数据结构地址 -> eax
+	movl APIC_ID,%eax		# 取当前任务（进程）数据结构地址 -> eax
+	shrl $24,%eax
+	movzbl _apicid_to_cpu(%eax),%eax
+	cmpl $0,_need_resched(,%eax,4)	# woke up a real-time task?
+	jne reschedule
+	movl _current_set(,%eax,4),%eax
 	cmpl $0,state(%eax)		# state
 	jne reschedule			# 如果当前任务不是就绪态（state不等于0），则执行调度程序
 	cmpl $0,counter(%eax)		# counter
@@ -112,9 +128,12 @@ _system_call:
 ret_from_sys_call:
 
 # 先判别当前任务是否是初始任务 task0，如果是则不必对其进行信号量方面的处理，直接返回。
-# _task 对应 C 程序中的task[]数组，直接引用 task 相当于引用task[0]	
-	movl _current,%eax
-	cmpl _task,%eax			# task[0] cannot have signals
+# _init_task 是 C 程序中任务 0 的 task_union，其地址就是任务 0 的任务结构指针
+	movl APIC_ID,%eax
+	shrl $24,%eax
+	movzbl _apicid_to_cpu(%eax),%eax
+	movl _current_set(,%eax,4),%eax
+	cmpl $_init_task,%eax		# task 0 cannot have signals
 	je 3f
 	
 # 通过对原调用程序代码选择符的检查来判断调用程序是否是内核任务（例如任务 1）。如果是则直接
@@ -144,7 +163,8 @@ ret_from_sys_call:
 	popl %ecx
 	testl %eax, %eax
 	jne 2b		# see if we need to switch tasks, or do more signals
-3:	popl %eax
+3:	call _unlock_kernel
+	popl %eax
 	popl %ebx
 	popl %ecx
 	popl %edx
@@ -169,6 +189,7 @@ _coprocessor_error:
 	mov %ax,%es
 	movl $0x17,%eax
 	mov %ax,%fs
+	call _lock_kernel
 	pushl $ret_from_sys_call
 	jmp _math_error
 
@@ -187,6 +208,7 @@ _device_not_available:
 	mov %ax,%es
 	movl $0x17,%eax
 	mov %ax,%fs
+	call _lock_kernel
 	pushl $ret_from_sys_call
 	clts				# clear TS so that we can use math
 	movl %cr0,%eax		# 控制寄存器 cr0
@@ -225,6 +247,7 @@ _timer_interrupt:
 	mov %ax,%es
 	movl $0x17,%eax
 	mov %ax,%fs
+	call _lock_kernel
 	incl _jiffies
 	
 # 由于初始化中断控制芯片时没有采用自动 EOI，所以这里需要发指令结束该硬件中断
@@ -239,6 +262,89 @@ _timer_interrupt:
 	addl $4,%esp		# task switching to accounting ...
 	jmp ret_from_sys_call
 
+/*
+ * The local APIC timer of the other CPUs. It doesn't touch jiffies,
+ * that is for the 8253 and the boot CPU.
+ */
+.align 2
+_apic_timer_interrupt:
+	push %ds
+	push %es
+	push %fs
+	pushl $-1		# fill in -1 for orig_eax
+	pushl %edx
+	pushl %ecx
+	pushl %ebx
+	pushl %eax
+	movl $0x10,%eax
+	mov %ax,%ds
+	mov %ax,%es
+	movl $0x17,%eax
+	mov %ax,%fs
+	movl $0,APIC_EOI	# EOI to the local APIC
+	call _lock_kernel
+	movl CS(%esp),%eax
+	andl $3,%eax		# %eax is CPL (0 or 3, 0=supervisor)
+	pushl %eax
+	call _smp_local_timer
+	addl $4,%esp
+	jmp ret_from_sys_call
+
+/*
+ * Another CPU woke up a task for us. If we were idle, getting us out of
+ * the hlt is all this is for. If it was a real-time task that has to
+ * pre-empt the user task we run, switch now rather than at the next
+ * tick. In the kernel, the system call looks at it on its way out.
+ */
+.align 2
+_reschedule_interrupt:
+	push %ds
+	push %es
+	push %fs
+	pushl $-1		# fill in -1 for orig_eax
+	pushl %edx
+	pushl %ecx
+	pushl %ebx
+	pushl %eax
+	movl $0x10,%eax
+	mov %ax,%ds
+	mov %ax,%es
+	movl $0x17,%eax
+	mov %ax,%fs
+	movl $0,APIC_EOI	# EOI to the local APIC
+	call _lock_kernel
+	cmpw $0x0f,CS(%esp)		# was old code segment supervisor ?
+	jne ret_from_sys_call
+	movl APIC_ID,%eax
+	shrl $24,%eax
+	movzbl _apicid_to_cpu(%eax),%eax
+	cmpl $0,_need_resched(,%eax,4)
+	jne reschedule
+	jmp ret_from_sys_call
+
+/*
+ * A new task starts here, in kernel mode, with the iret frame fork put
+ * on its kernel stack to take it to user mode. It holds the kernel lock
+ * of whoever switched to it, and has to let go of it first.
+ */
+.align 2
+_ret_from_fork:
+	pushl %eax
+	pushl %ecx
+	pushl %edx
+	push %ds
+	push %es
+	movl $0x10,%eax
+	mov %ax,%ds
+	mov %ax,%es
+	call _schedule_tail
+	pop %es
+	pop %ds
+	popl %edx
+	popl %ecx
+	popl %eax
+	iret
+
 .align 2
 _sys_execve:
 	lea EIP(%esp),%eax
@@ -257,8 +363,24 @@ _sys_fork:
 	pushl %edi
 	pushl %ebp
 	pushl %eax
+	pushl $0			# not a vfork
 	call _copy_process		# kernel/fork.c
-	addl $20,%esp			# 丢弃这里所有的压栈内容
+	addl $24,%esp			# 丢弃这里所有的压栈内容
+1:	ret
+
+.align 2
+_sys_vfork:
+	call _find_empty_process
+	testl %eax,%eax
+	js 1f
+	push %gs
+	pushl %esi
+	pushl %edi
+	pushl %ebp
+	pushl %eax
+	pushl $1
+	call _copy_process
+	addl $24,%esp
 1:	ret
 
 #### int 46 -- (int 0x2E) 硬盘中断处理程序，响应硬件中断请求IRQ14
@@ -275,6 +397,7 @@ _hd_interrupt:
 	mov %ax,%es
 	movl $0x17,%eax
 	mov %ax,%fs
+	call _lock_kernel
 	movb $0x20,%al
 	outb %al,$0xA0		# EOI to interrupt controller #1
 	jmp 1f			# give port chance to breathe
@@ -289,6 +412,7 @@ _hd_interrupt:
 	movl $_unexpected_hd_interrupt,%edx		# 若_do_hd 为空
 1:	outb %al,$0x20
 	call *%edx		# "interesting" way of handling intr.
+	call _unlock_kernel
 	pop %fs
 	pop %es
 	pop %ds
@@ -311,6 +435,7 @@ _floppy_interrupt:
 	mov %ax,%es
 	movl $0x17,%eax
 	mov %ax,%fs
+	call _lock_kernel
 	movb $0x20,%al
 	outb %al,$0x20		# EOI to interrupt controller #1
 	xorl %eax,%eax
@@ -319,6 +444,7 @@ _floppy_interrupt:
 	jne 1f
 	movl $_unexpected_floppy_interrupt,%eax
 1:	call *%eax		# "interesting" way of handling intr.
+	call _unlock_kernel
 	pop %fs
 	pop %es
 	pop %ds
@@ -0,0 +1,60 @@
+/*
+ *  linux/kernel/trampoline.s
+ */
+
+/*
+ * This is where the other CPUs start out. They wake up in real mode at
+ * the page the startup IPI points to, so smp_init() copies the first
+ * part (up to trampoline_end) to a page below 1MB. It only gets into
+ * protected mode and jumps to ap_entry, in the kernel proper. gas can't
+ * do 16-bit code, so that part is hand-assembled.
+ */
+.globl _trampoline,_trampoline_end,_ap_entry
+
+.text
+.align 2
+_trampoline:
+	.byte 0xfa			# cli
+	.byte 0x8c,0xc8			# movw %cs,%ax
+	.byte 0x8e,0xd8			# movw %ax,%ds
+	.byte 0x0f,0x01,0x16,0x20,0x00	# lgdt gdt_48 (at offset 0x20)
+	.byte 0x0f,0x20,0xc0		# movl %cr0,%eax
+	.byte 0x0c,0x01			# orb $1,%al	(PE)
+	.byte 0x0f,0x22,0xc0		# movl %eax,%cr0
+	.byte 0x66,0xea			# ljmpl $8,$_ap_entry
+	.long _ap_entry
+	.word 8
+	.byte 0,0,0,0,0,0		# pad to 0x20
+gdt_48:
+	.word 256*8-1			# same gdt as everybody else
+	.long _gdt
+_trampoline_end:
+
+/*
+ * Here we are in 32-bit mode, with the kernel segments, but without
+ * paging. The kernel is mapped 1:1 at the bottom of pg_dir, so turning
+ * it on doesn't move us. cr0 is copied from the boot CPU, which gets us
+ * its fpu bits too. The stack is the kernel stack of our idle task.
+ */
+.align 2
+_ap_entry:
+	movl $0x10,%eax
+	mov %ax,%ds
+	mov %ax,%es
+	mov %ax,%fs
+	mov %ax,%gs
+	lss _ap_stack,%esp
+	xorl %eax,%eax
+	movl %eax,%cr3			/* pg_dir is at 0x0000 */
+	movl _ap_cr0,%eax
+	movl %eax,%cr0
+	jmp 1f				/* flush prefetch-queue */
+1:	lidt idt_descr
+	call _start_secondary
+2:	jmp 2b				/* not reached */
+
+.align 2
+.word 0
+idt_descr:
+	.word 256*8-1			# idt contains 256 entries
+	.long _idt
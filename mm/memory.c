@@ -32,6 +32,7 @@
 
 #include <asm/system.h>
 
+#include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/head.h>
 #include <linux/kernel.h>
@@ -41,75 +42,110 @@ current->start_code + current->end_code)
 
 unsigned long HIGH_MEMORY = 0;
 
-#define copy_page(from,to) \
-__asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024):"cx","di","si")
-
 // 一个数组元素对应一页内存
-unsigned char mem_map [ PAGING_PAGES ] = {0,};
+unsigned char * mem_map = NULL;
+unsigned long * page_swap = NULL;
+unsigned long paging_pages = 0;
+
+int fault_around_pages = FAULT_AROUND_PAGES;
+
+#define MIN_RA_PAGES 2
+#define MAX_RA_PAGES 16
 
 /*
- * Free a page of memory at physical address 'addr'. Used by
- * 'free_page_tables()'
+ * Drop a reference to the page table at 'table'. After a fork() the
+ * tables are shared (see copy_page_tables()), and mem_map[] counts the
+ * directories they are in: only the last one frees the pages in it.
  */
-// addr -- 物理内存页的物理地址
-void free_page(unsigned long addr)
+static void put_page_table(unsigned long table)
 {
-	if (addr < LOW_MEM) return;
-	if (addr >= HIGH_MEMORY)
-		panic("trying to free nonexistent page");
-	addr -= LOW_MEM;
-	addr >>= 12;  // 除以4096
-	if (mem_map[addr]--) return;
-	mem_map[addr]=0;
-	panic("trying to free free page");
+	unsigned long *pg_table = (unsigned long *) table;
+	unsigned long nr;
+
+	if (mem_map[MAP_NR(table)] == 1)
+		for (nr=0 ; nr<1024 ; nr++) {
+			if (*pg_table) {
+				if (1 & *pg_table)  // 页表项是否有效
+					free_page(0xfffff000 & *pg_table);
+				else
+					swap_free(*pg_table >> 1);
+				*pg_table = 0;
+			}
+			pg_table++;
+		}
+	free_page(table);
 }
 
 /*
- * This function frees a continuos block of page tables, as needed
- * by 'exit()'. As does copy_page_tables(), this handles only 4Mb blocks.
+ * Free the page tables (and the pages in them) of 'size' directory
+ * entries starting at 'dir'.
+ */
+static void free_dir_entries(unsigned long * dir, unsigned long size)
+{
+	for ( ; size-->0 ; dir++) {
+		if (!(1 & *dir))  // 如果该页目录项无效(P位=0)，表明没有对应的页表
+			continue;
+		put_page_table(0xfffff000 & *dir); // 取页表地址
+		*dir = 0; // 页目录项清零
+	}
+}
+
+/*
+ * This function frees a continuos block of page tables of the current
+ * task, as needed by 'exit()'. As does copy_page_tables(), this handles
+ * only 4Mb blocks.
  */
 // from -- 线性地址
 // size -- 释放的长度，单位是字节
 int free_page_tables(unsigned long from,unsigned long size)
 {
-	unsigned long *pg_table;
-	unsigned long * dir, nr;
-
 	// from 该线性地址的后22个比特位必须都是0
 	// 一个页表有1024项，每项对应一个物理页，一个物理页长度4KB，
 	// 所以 from 要4MB对齐
 	if (from & 0x3fffff)
 		panic("free_page_tables called with wrong alignment");
-	if (!from)
+	if (from < TASK_BASE)
 		panic("Trying to free up swapper memory space");
 	// 该函数只处理4MB的内存块，所以要把待释放的字节数换算为待释放
 	// 的页目录项，即要释放多少个页目录项。所以即使要释放的字节数仅有
 	// 1个字节，换算后就要释放4MB的内存块
 	size = (size + 0x3fffff) >> 22;
-	// 页目录表的物理地址范围是 0-4095 之间，每个目录项长度为4字节，
-	// 所以页目录项的合法地址是 0-4092(0xffc)，并且要4字节对齐
-	dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
-	for ( ; size-->0 ; dir++) {
-		if (!(1 & *dir))  // 如果该页目录项无效(P位=0)，表明没有对应的页表
-			continue;
-		pg_table = (unsigned long *) (0xfffff000 & *dir); // 取页表地址
-		for (nr=0 ; nr<1024 ; nr++) {
-			if (*pg_table) {
-				if (1 & *pg_table)  // 页表项是否有效
-					free_page(0xfffff000 & *pg_table);
-				else
-					swap_free(*pg_table >> 1);
-				*pg_table = 0;
-			}
-			pg_table++;
-		}
-		free_page(0xfffff000 & *dir); // 页表物理地址在1MB以内，所以这句话没实际作用？
-		*dir = 0; // 页目录项清零
-	}
-	invalidate();
+	// 页目录表现在是每个任务自己的，其物理地址在 tss.cr3 中
+	free_dir_entries(PAGE_DIR_OFFSET(current->tss.cr3,from),size);
+	invalidate_range(from, from + (size << 22));
 	return 0;
 }
 
+/*
+ * A page directory for a new task. The kernel part of it (everything
+ * below TASK_BASE) is copied from pg_dir, so the kernel page tables
+ * are the same for everybody: they never change after boot.
+ */
+unsigned long new_page_dir(void)
+{
+	unsigned long dir;
+	int i;
+
+	if (!(dir = get_free_page()))
+		return 0;
+	for (i = 0 ; i < (TASK_BASE>>22) ; i++)
+		((unsigned long *) dir)[i] = pg_dir[i];
+	return dir;
+}
+
+/*
+ * Free a page directory, and whatever is left above TASK_BASE in it.
+ * Used by release(), and by fork() when copy_page_tables() failed half
+ * way through.
+ */
+void free_page_dir(unsigned long dir)
+{
+	if (dir == (unsigned long) pg_dir)
+		panic("Trying to free up swapper page directory");
+	free_dir_entries(PAGE_DIR_OFFSET(dir,TASK_BASE),1024-(TASK_BASE>>22));
+	free_page(dir);
+}
+
 /*
  *  Well, here is one of the most complicated functions in mm. It
  * copies a range of linerar addresses by copying only the pages.
@@ -126,34 +162,52 @@ int free_page_tables(unsigned long from,unsigned long size)
  * doesn't take any more memory - we don't copy-on-write in the low
  * 1 Mb-range, so the pages can be shared with the kernel. Thus the
  * special case for nr=xxxx.
+ *
+ * 'from' is in the current page directory, 'to' in 'dir', the one of
+ * the new task.
+ *
+ * NOTE 3! Above that, we don't copy the page tables at all any more:
+ * both directories get the same ones, write-protected in the directory
+ * entry, and the first write anywhere in their 4Mb makes the writer a
+ * copy of its own (see unshare_page_table()). A fork() that is soon
+ * followed by an exec() then costs next to nothing.
  */
 // from to -- 线性地址
 // size -- 要复制的长度，单位是字节 
-int copy_page_tables(unsigned long from,unsigned long to,long size)
+// dir -- 新任务页目录表的物理地址
+int copy_page_tables(unsigned long from,unsigned long to,long size,
+	unsigned long dir)
 {
 	unsigned long * from_page_table;
 	unsigned long * to_page_table;
 	unsigned long this_page;
 	unsigned long * from_dir, * to_dir;
 	unsigned long new_page;
-	unsigned long nr;
+	unsigned long nr, end;
 
 	if ((from&0x3fffff) || (to&0x3fffff))
 		panic("copy_page_tables called with wrong alignment");
 	/*
-	   对于32位的线性地址，高10位是页目录项的索引值，即from>>22，但因为页目录表
-	   的物理基地址是0，并且每项页目录项的大小是4个字节，所以from>>2，再<<2(乘以4)
-	   将得到该页目录项的地址，该地址是物理地址，因为内核态数据段的基地址是0
+	   对于32位的线性地址，高10位是页目录项的索引值，即from>>22，每项页目录项
+	   的大小是4个字节，所以from>>2，再<<2(乘以4)得到该页目录项在页目录表中的偏移，
+	   加上页目录表的物理地址就是该页目录项的地址，因为内核态数据段的基地址是0
 	*/
-	from_dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
-	to_dir = (unsigned long *) ((to>>20) & 0xffc);
-	// 将要复制的字节数转换为要多少个4MB块，比如一个进程的段限长是64MB，则需要16个页表
+	from_dir = PAGE_DIR_OFFSET(current->tss.cr3,from);
+	to_dir = PAGE_DIR_OFFSET(dir,to);
+	// 将要复制的字节数转换为要多少个4MB块，比如一个进程的段限长是3GB，则最多需要768个页表
 	size = ((unsigned) (size+0x3fffff)) >> 22;
+	end = from + (size << 22);
 	for( ; size-->0 ; from_dir++,to_dir++) {
 		if (1 & *to_dir)
 			panic("copy_page_tables: already exist");
 		if (!(1 & *from_dir))
 			continue;
+		if (from) {
+			*from_dir &= ~2;
+			*to_dir = *from_dir;
+			mem_map[MAP_NR(0xfffff000 & *from_dir)]++;
+			continue;
+		}
 		from_page_table = (unsigned long *) (0xfffff000 & *from_dir);
 		// 为新进程申请1个页表，可存放4MB的数据(1024x4KB=4MB)
 		if (!(to_page_table = (unsigned long *) get_free_page()))
@@ -165,6 +219,10 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 			if (!this_page)
 				continue;
 			if (!(1 & this_page)) {
+				if (swap_duplicate(this_page>>1)) {
+					*to_page_table = this_page;
+					continue;
+				}
 				if (!(new_page = get_free_page()))
 					return -1;
 				read_swap_page(this_page>>1, (char *) new_page);
@@ -182,7 +240,7 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 			}
 		}
 	}
-	invalidate();
+	invalidate_range(from, end);	/* the parent's tables went read-only */
 	return 0;
 }
 
@@ -200,13 +258,13 @@ static unsigned long put_page(unsigned long page,unsigned long address)
 {
 	unsigned long tmp, *page_table;
 
-/* NOTE !!! This uses the fact that _pg_dir=0 */
+/* NOTE !!! This puts it in the page directory of the current task */
 
 	if (page < LOW_MEM || page >= HIGH_MEMORY)
 		printk("Trying to put page %p at %p\n",page,address);
 	if (mem_map[(page-LOW_MEM)>>12] != 1)
 		printk("mem_map disagrees with %p at %p\n",page,address);
-	page_table = (unsigned long *) ((address>>20) & 0xffc);
+	page_table = PAGE_DIR_OFFSET(current->tss.cr3,address);
 	if ((*page_table)&1)
 		page_table = (unsigned long *) (0xfffff000 & *page_table);
 	else {
@@ -215,6 +273,15 @@ static unsigned long put_page(unsigned long page,unsigned long address)
 		*page_table = tmp | 7;
 		page_table = (unsigned long *) tmp;
 	}
+/*
+ * The page table may be shared after a fork(), and we may have slept
+ * getting the page: somebody else's fault may have filled the entry
+ * meanwhile. Then theirs is as good as ours.
+ */
+	if (page_table[(address>>12) & 0x3ff]) {
+		free_page(page);
+		return page;
+	}
 	page_table[(address>>12) & 0x3ff] = page | 7;
 /* no need for invalidate */
 	return page;
@@ -230,13 +297,13 @@ unsigned long put_dirty_page(unsigned long page, unsigned long address)
 {
 	unsigned long tmp, *page_table;
 
-/* NOTE !!! This uses the fact that _pg_dir=0 */
+/* NOTE !!! This puts it in the page directory of the current task */
 
 	if (page < LOW_MEM || page >= HIGH_MEMORY)
 		printk("Trying to put page %p at %p\n",page,address);
 	if (mem_map[(page-LOW_MEM)>>12] != 1)
 		printk("mem_map disagrees with %p at %p\n",page,address);
-	page_table = (unsigned long *) ((address>>20) & 0xffc);  /* 页目录项地址 */
+	page_table = PAGE_DIR_OFFSET(current->tss.cr3,address);  /* 页目录项地址 */
 	if ((*page_table)&1)
 		page_table = (unsigned long *) (0xfffff000 & *page_table);  /* 页表地址 */
 	else {
@@ -250,33 +317,125 @@ unsigned long put_dirty_page(unsigned long page, unsigned long address)
 	return page;
 }
 
+/*
+ * Give the current task a page table of its own for 'address', if the
+ * one it has is shared after a fork(). The pages in it are shared from
+ * now on instead, copy-on-write as usual: so they are write-protected
+ * in the old table as well. If we're the last user of the table, it's
+ * just made writable again. Returns 0 if out of memory.
+ */
+static int unshare_page_table(unsigned long address)
+{
+	unsigned long *dir, *old_table, *new_table;
+	unsigned long page, tmp, new_page = 0;
+	int nr;
+
+	dir = PAGE_DIR_OFFSET(current->tss.cr3,address);
+repeat:
+	if ((3 & *dir) != 1) {	/* not there, or ours already */
+		if (new_page)
+			free_page(new_page);
+		return 1;
+	}
+	old_table = (unsigned long *) (0xfffff000 & *dir);
+	if (mem_map[MAP_NR((unsigned long) old_table)] == 1) {
+		if (new_page)
+			free_page(new_page);
+		*dir |= 2;
+		invalidate_range(address & 0xffc00000,
+			(address & 0xffc00000) + 0x400000);
+		return 1;
+	}
+	if (!new_page) {
+		if (!(new_page = get_free_page()))
+			return 0;
+		goto repeat;	/* we may have slept */
+	}
+	new_table = (unsigned long *) new_page;
+	for (nr = 0 ; nr < 1024 ; nr++) {
+		if (!(page = old_table[nr]))
+			continue;
+		if (!(1 & page)) {
+			if (swap_duplicate(page >> 1)) {
+				new_table[nr] = page;
+				continue;
+			}
+/* too many users for the swap count: we get a copy in memory */
+			if (!(tmp = get_free_page())) {
+				put_page_table(new_page);
+				return 0;
+			}
+			if (old_table[nr] != page) {	/* changed while we slept */
+				free_page(tmp);
+				nr--;
+				continue;
+			}
+			read_swap_page(page >> 1, (char *) tmp);
+			new_table[nr] = tmp | (PAGE_DIRTY | 7);
+			continue;
+		}
+		page &= ~2;
+		old_table[nr] = new_table[nr] = page;
+		if ((page & 0xfffff000) >= LOW_MEM)
+			mem_map[MAP_NR(page & 0xfffff000)]++;
+	}
+	*dir = new_page | 7;
+	put_page_table((unsigned long) old_table);
+	invalidate_range(address & 0xffc00000,
+		(address & 0xffc00000) + 0x400000);
+	return 1;
+}
+
 // 取消写保护页面，用于页异常中断过程中写保护异常的处理（写时复制）
 // table_entry -- 页表项指针
-void un_wp_page(unsigned long * table_entry)
+// address -- 页面线性地址，只需刷新这一页的 TLB
+void un_wp_page(unsigned long * table_entry, unsigned long address)
 {
 	unsigned long old_page,new_page;
 
 	old_page = 0xfffff000 & *table_entry;
 	// 其在页面映射字节图数组中值为 1 表示没用被共享
 	if (old_page >= LOW_MEM && mem_map[MAP_NR(old_page)]==1) {
+		delete_from_swap_cache(old_page);
 		*table_entry |= 2;  // R/w => 1,表示可写
-		invalidate();
+		invalidate_page(address);
 		return;
 	}
 	if (!(new_page=get_free_page()))
 		oom();
 	if (old_page >= LOW_MEM)
 		mem_map[MAP_NR(old_page)]--;
-	copy_page(old_page,new_page);
+	if (old_page != (unsigned long) empty_zero_page)  /* new_page is clear */
+		copy_page(old_page,new_page);
 	*table_entry = new_page | 7;
-	invalidate();
+	invalidate_page(address);
 }	
 
+// 验证页面是否可写，如果不能写则复制页面。
+// address -- 线性地址
+void write_verify(unsigned long address)
+{
+	unsigned long page;
+
+	if (!unshare_page_table(address))
+		oom();
+	if (!( (page = *PAGE_DIR_OFFSET(current->tss.cr3,address)) &1))
+		return;
+	page &= 0xfffff000;  // 获取页表地址
+	page += ((address>>10) & 0xffc);  // 获取页表项地址
+	if ((3 & *(unsigned long *) page) == 1)  /* non-writeable, present */
+		un_wp_page((unsigned long *) page, address);
+	return;
+}
+
 /*
  * This routine handles present pages, when users try to write
  * to a shared page. It is done by copying the page to a new address
  * and decrementing the shared-page counter for the old page.
  *
+ * The page table it is in may be the one that's shared (after a fork)
+ * instead, in which case the page itself may well be writable.
+ *
  * If it's in code space we exit with a segment error.
  */
 // 页异常中断处理调用的 C 函数。写共享页面处理函数，在 page.s 中被调用。
@@ -285,7 +444,7 @@ void un_wp_page(unsigned long * table_entry)
 // address -- 页面线性地址 
 void do_wp_page(unsigned long error_code,unsigned long address)
 {
-	if (address < TASK_SIZE)
+	if (address < TASK_BASE)
 		printk("\n\rBAD! KERNEL MEMORY WP-ERR!\n\r");
 	if (address - current->start_code > TASK_SIZE) {
 		printk("Bad things happen: page error in do_wp_page\n\r");
@@ -297,25 +456,31 @@ void do_wp_page(unsigned long error_code,unsigned long address)
 	if (CODE_SPACE(address))
 		do_exit(SIGSEGV);
 #endif
-	un_wp_page((unsigned long *)
-		(((address>>10) & 0xffc) + (0xfffff000 &
-		*((unsigned long *) ((address>>20) &0xffc)))));
-
+	write_verify(address);
 }
 
-// 验证页面是否可写，如果不能写则复制页面。
-// address -- 线性地址
-void write_verify(unsigned long address)
+/*
+ * A read of anonymous memory nobody has written to yet: it gets the
+ * zero page, read-only. The first write makes it a page of its own in
+ * do_wp_page(), like any other copy-on-write page.
+ */
+static void get_zero_page(unsigned long address)
 {
-	unsigned long page;
+	unsigned long tmp, *page_table;
 
-	if (!( (page = *((unsigned long *) ((address>>20) & 0xffc)) )&1))
-		return;
-	page &= 0xfffff000;  // 获取页表地址
-	page += ((address>>10) & 0xffc);  // 获取页表项地址
-	if ((3 & *(unsigned long *) page) == 1)  /* non-writeable, present */
-		un_wp_page((unsigned long *) page);
-	return;
+	page_table = PAGE_DIR_OFFSET(current->tss.cr3,address);
+	if ((*page_table)&1)
+		page_table = (unsigned long *) (0xfffff000 & *page_table);
+	else {
+		if (!(tmp=get_free_page()))
+			oom();
+		*page_table = tmp | 7;
+		page_table = (unsigned long *) tmp;
+	}
+	if (!page_table[(address>>12) & 0x3ff])	/* see put_page() */
+		page_table[(address>>12) & 0x3ff] =
+			(unsigned long) empty_zero_page | 5;
+/* no need for invalidate */
 }
 
 void get_empty_page(unsigned long address)
@@ -345,9 +510,10 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 	unsigned long to_page;
 	unsigned long phys_addr;
 
-	from_page = to_page = ((address>>20) & 0xffc);
-	from_page += ((p->start_code>>20) & 0xffc);
-	to_page += ((current->start_code>>20) & 0xffc);
+	from_page = (unsigned long)
+		PAGE_DIR_OFFSET(p->tss.cr3,p->start_code+address);
+	to_page = (unsigned long)
+		PAGE_DIR_OFFSET(current->tss.cr3,current->start_code+address);
 /* is there a page-directory at from? */
 	from = *(unsigned long *) from_page;
 	if (!(from & 1))
@@ -361,6 +527,9 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 	phys_addr &= 0xfffff000;
 	if (phys_addr >= HIGH_MEMORY || phys_addr < LOW_MEM)
 		return 0;
+/* clean, but only as far as the swap cache goes: not the file's page */
+	if (page_swap[MAP_NR(phys_addr)])
+		return 0;
 	to = *(unsigned long *) to_page;
 	if (!(to & 1))
 		if (to = get_free_page())
@@ -369,8 +538,9 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 			oom();
 	to &= 0xfffff000;
 	to_page = to + ((address>>10) & 0xffc);
-	if (1 & *(unsigned long *) to_page) // 对应的页面已经存在
-		panic("try_to_share: to_page already exists");
+/* filled in while we slept, by somebody sharing the page table */
+	if (*(unsigned long *) to_page) // 对应的页面已经存在
+		return 1;
 /* share them: write-protect */
 	*(unsigned long *) from_page &= ~2;
 	*(unsigned long *) to_page = *(unsigned long *) from_page;
@@ -391,28 +561,106 @@ static int try_to_share(unsigned long address, struct task_struct * p)
  */
 static int share_page(struct m_inode * inode, unsigned long address)
 {
-	struct task_struct ** p;
+	struct task_struct * p;
 
 	if (inode->i_count < 2 || !inode)
 		return 0;
-	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-		if (!*p)
-			continue;
-		if (current == *p)
+	for_each_task(p) {
+		if (current == p)
 			continue;
 		if (address < LIBRARY_OFFSET) {
-			if (inode != (*p)->executable)
+			if (inode != p->executable)
 				continue;
 		} else {
-			if (inode != (*p)->library)
+			if (inode != p->library)
 				continue;
 		}
-		if (try_to_share(address,*p))
+		if (try_to_share(address,p))
 			return 1;
 	}
 	return 0;
 }
 
+/*
+ * We just got the page at 'address' (relative to the data space, as for
+ * share_page()) of 'inode'. A new copy of a busy program would go on to
+ * fault on the pages around it one at a time, even though they are all
+ * in memory in the other copies: so we look for those right away, and
+ * map what we find. Only in the window of fault_around_pages that the
+ * page is in, and in the page table it's in, as that one is there.
+ */
+static void fault_around(struct m_inode * inode, unsigned long address)
+{
+	unsigned long start, end, tmp;
+	unsigned long * page_table;
+
+	if (fault_around_pages <= 1 || inode->i_count < 2)
+		return;
+	start = address - address % (fault_around_pages * PAGE_SIZE);
+	end = start + fault_around_pages * PAGE_SIZE;
+	if (address < LIBRARY_OFFSET) {
+		if (end > current->end_data)
+			end = current->end_data;
+	} else if (start < LIBRARY_OFFSET)
+		start = LIBRARY_OFFSET;
+	tmp = (current->start_code + address) & 0xffc00000;
+	page_table = (unsigned long *)
+		(0xfffff000 & *PAGE_DIR_OFFSET(current->tss.cr3,tmp));
+	for ( ; start < end ; start += PAGE_SIZE) {
+		if (((current->start_code + start) & 0xffc00000) != tmp)
+			continue;
+		if (page_table[((current->start_code + start) >> 12) & 0x3ff])
+			continue;
+		if (share_page(inode,start))
+			current->flt_around++;
+	}
+}
+
+/*
+ * Readahead for demand loading. A program gets loaded mostly front to
+ * back, but a page at a time, each fault waiting for its own 4 blocks.
+ * So the inode remembers where the last fault on it left off, and the
+ * blocks read ahead after that (i_ra_start up to i_ra_end). A fault on
+ * the next page, or on one of those, means the pattern holds: the
+ * window doubles, up to MAX_RA_PAGES, and the blocks in it that haven't
+ * been asked for yet are queued with READA. Any other fault starts
+ * over. 'block' is the first block of the faulting page.
+ */
+static void file_readahead(struct m_inode * inode, unsigned long block)
+{
+	struct buffer_head * bh;
+	unsigned long end, size;
+	int nr;
+
+	if (block >= inode->i_ra_start && block < inode->i_ra_end)
+		current->ra_hits++;
+	else if (block != inode->i_ra_next) {
+		inode->i_ra_next = block + 4;
+		inode->i_ra_pages = 0;
+		inode->i_ra_start = inode->i_ra_end = 0;
+		return;
+	}
+	inode->i_ra_next = block + 4;
+	if (inode->i_ra_pages < MAX_RA_PAGES)
+		inode->i_ra_pages = inode->i_ra_pages ?
+			2 * inode->i_ra_pages : MIN_RA_PAGES;
+	if (inode->i_ra_end < block + 4)
+		inode->i_ra_start = inode->i_ra_end = block + 4;
+	end = block + 4 + 4 * inode->i_ra_pages;
+	size = (inode->i_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	if (end > size)
+		end = size;
+	for ( ; inode->i_ra_end < end ; inode->i_ra_end++) {
+		if (!(nr = bmap(inode,inode->i_ra_end)))
+			continue;
+		if (!(bh = getblk(inode->i_dev,nr)))
+			continue;
+		if (!bh->b_uptodate)
+			ll_rw_block(READA,bh);
+		bh->b_count--;
+	}
+}
+
 // 页异常中断处理调用的函数，处理缺页异常情况。
 // error_code -- 由 CPU 自动生成
 // address -- 页面的线性地址
@@ -424,20 +672,22 @@ void do_no_page(unsigned long error_code,unsigned long address)
 	int block,i;
 	struct m_inode * inode;
 
-	if (address < TASK_SIZE)
+	if (address < TASK_BASE)
 		printk("\n\rBAD!! KERNEL PAGE MISSING\n\r");
 	if (address - current->start_code > TASK_SIZE) {
 		printk("Bad things happen: nonexistent page error in do_no_page\n\r");
 		do_exit(SIGSEGV);
 	}
-	page = *(unsigned long *) ((address >> 20) & 0xffc);
+	if ((error_code & 2) && !unshare_page_table(address))
+		oom();
+	page = *PAGE_DIR_OFFSET(current->tss.cr3,address);
 	if (page & 1) {
 		page &= 0xfffff000;
 		page += (address >> 10) & 0xffc;
 		tmp = *(unsigned long *) page;
 		// 页表项有效但页面被交换出，则把页面换进内存
 		if (tmp && !(1 & tmp)) {
-			swap_in((unsigned long *) page);
+			swap_in((unsigned long *) page, error_code & 2);
 			return;
 		}
 	}
@@ -460,16 +710,23 @@ void do_no_page(unsigned long error_code,unsigned long address)
 		block = 0;
 	}
 	if (!inode) {
-		get_empty_page(address);
+		if (error_code & 2)
+			get_empty_page(address);
+		else
+			get_zero_page(address);
 		return;
 	}
-	if (share_page(inode,tmp))
+	if (share_page(inode,tmp)) {
+		fault_around(inode,tmp);
 		return;
+	}
 	if (!(page = get_free_page()))
 		oom();
+	current->maj_flt++;
 /* remember that 1 block is used for header */
 	for (i=0 ; i<4 ; block++,i++)
 		nr[i] = bmap(inode,block);
+	file_readahead(inode,block-4);
 	bread_page(page,inode->i_dev,nr);
 	// 超过 current->end_data 的部分要清零
 	i = tmp + 4096 - current->end_data;
@@ -480,34 +737,125 @@ void do_no_page(unsigned long error_code,unsigned long address)
 		tmp--;
 		*(char *)tmp = 0;
 	}
-	if (put_page(page,address))
+	if (put_page(page,address)) {
+		fault_around(inode,address - current->start_code);
 		return;
+	}
 	free_page(page);
 	oom();
 }
 
+/*
+ * head.s only maps the first 16MB. Map the rest of memory the same way,
+ * with page tables taken from 'start_mem', and set up an empty one for
+ * the fixed mappings. Every page directory copies the kernel entries
+ * from pg_dir, so this has to be done before the first fork.
+ */
+static unsigned long paging_init(unsigned long start_mem,
+	unsigned long end_mem)
+{
+	unsigned long * pg_table, addr;
+	int i;
+
+	for (addr = 0x1000000 ; addr < end_mem ; addr += 0x400000) {
+		pg_table = (unsigned long *) start_mem;
+		start_mem += PAGE_SIZE;
+		for (i = 0 ; i < 1024 ; i++, pg_table++)
+			if (addr + (i << 12) < end_mem)
+				*pg_table = (addr + (i << 12)) | 7;
+			else
+				*pg_table = 0;
+		pg_dir[addr >> 22] = (start_mem - PAGE_SIZE) | 7;
+	}
+	pg_table = (unsigned long *) start_mem;
+	start_mem += PAGE_SIZE;
+	for (i = 0 ; i < 1024 ; i++)
+		pg_table[i] = 0;
+	pg_dir[FIXMAP_BASE >> 22] = ((unsigned long) pg_table) | 7;
+/*
+ * smp_processor_id() reads the local APIC id on every way into the
+ * kernel, MP table or not: so map it (uncached) at its usual address
+ * now. smp_init() maps it again if the MP table says it's elsewhere.
+ * Without an APIC this reads back all ones, which is CPU 0 as well.
+ */
+	pg_table[(APIC_BASE >> 12) & 0x3ff] = APIC_DEFAULT_PHYS_BASE | 0x1b;
+	invalidate();
+	return start_mem;
+}
+
+/* invlpg is a 486 instruction: a 386 can't flip the AC flag */
+int has_invlpg = 0;
+
+static int check_invlpg(void)
+{
+	unsigned long a, b;
+
+	__asm__("pushfl ; popl %0 ; movl %0,%1\n\t"
+		"xorl $0x40000,%0 ; pushl %0 ; popfl\n\t"
+		"pushfl ; popl %0 ; pushl %1 ; popfl"
+		:"=&r" (a),"=&r" (b));
+	return ((a ^ b) & 0x40000) != 0;
+}
+
+/*
+ * The kernel page tables, mem_map[] and the bitmaps of the buddy
+ * allocator are all sized to the memory we found, and taken from the
+ * start of main memory. The rest is free.
+ */
 void mem_init(long start_mem, long end_mem)
 {
 	int i;
 
+	has_invlpg = check_invlpg();
+	start_mem = (start_mem + 4095) & ~4095;
+	start_mem = paging_init(start_mem, end_mem);
 	HIGH_MEMORY = end_mem;
-	for (i=0 ; i<PAGING_PAGES ; i++) // PAGING_PAGES size is 15M, i<15M/4096
+	paging_pages = MAP_NR(end_mem);
+	mem_map = (unsigned char *) start_mem;
+	start_mem += (paging_pages + 3) & ~3;
+	page_swap = (unsigned long *) start_mem;
+	start_mem += paging_pages * 4;
+	for (i=0 ; i<paging_pages ; i++) {
 		mem_map[i] = USED;
+		page_swap[i] = 0;
+	}
+	start_mem = free_area_init(start_mem);
+	start_mem = (start_mem + 4095) & ~4095;
 	i = MAP_NR(start_mem); // don't use some pages since 0 ? 
 	end_mem -= start_mem;
 	end_mem >>= 12;  // number of main memory pages
-	while (end_mem-->0)
-		mem_map[i++]=0;  // mark main memory pages by 0
+/*
+ * A task is no use without a handful of pages (task_struct, page
+ * directory and tables, some memory of its own), so there's no point
+ * letting in more of them than an eighth of memory could hold. But
+ * never fewer than the 64 there used to be room for.
+ */
+	max_tasks = end_mem >> 3;
+	if (max_tasks < 64)
+		max_tasks = 64;
+/* hand main memory to the buddy allocator, a page at a time */
+	while (end_mem-->0) {
+		mem_map[i] = 1;
+		free_page(LOW_MEM + (i++ << 12));
+	}
+/* keep 1/128th of it free, and at least 16 pages */
+	pages_min = nr_free_pages >> 7;
+	if (pages_min < 16)
+		pages_min = 16;
+	pages_low = pages_min * 2;
+	pages_high = pages_min * 3;
+	zswap_init();
 }
 
 void show_mem(void)
 {
 	int i,j,k,free=0,total=0;
 	int shared=0;
-	unsigned long * pg_tbl;
+	unsigned long * pg_tbl, * dir;
+	struct task_struct * p;
 
 	printk("Mem-info:\n\r");
-	for(i=0 ; i<PAGING_PAGES ; i++) {
+	for(i=0 ; i<paging_pages ; i++) {
 		if (mem_map[i] == USED)
 			continue;
 		total++;
@@ -517,32 +865,56 @@ void show_mem(void)
 			shared += mem_map[i]-1;
 	}
 	printk("%d free pages of %d\n\r",free,total);
+	show_free_areas();
 	printk("%d pages shared\n\r",shared);
-	k = 0;
-	for(i=4 ; i<1024 ;) {
-		if (1&pg_dir[i]) {
-			if (pg_dir[i]>HIGH_MEMORY) {
+	printk("Reclaim: %d scanned, %d referenced, %d reclaimed\n\r",
+		reclaim_stats.scanned, reclaim_stats.referenced,
+		reclaim_stats.reclaimed);
+	printk("kswapd ran %d times, %d direct reclaims (free %d/%d/%d)\n\r",
+		reclaim_stats.kswapd, reclaim_stats.direct,
+		pages_min, pages_low, pages_high);
+	printk("%d pages swapped out in %d writes\n\r",
+		reclaim_stats.swapped, reclaim_stats.swap_writes);
+	printk("Swap cache: %d hits, %d pages dropped without a write\n\r",
+		reclaim_stats.cache_hits, reclaim_stats.cache_drops);
+	printk("Swap readahead: %d hits, %d misses\n\r",
+		reclaim_stats.ra_hits, reclaim_stats.ra_misses);
+/* pool objects are in 128 byte chunks, 32 to a page */
+	if ((i = zswap_stats.bytes >> 7))
+		i = zswap_stats.stored * 3200 / i;
+	printk("Compressed swap: %d pages in %d bytes (ratio %d.%02d), "
+		"pool %d/%d pages\n\r",
+		zswap_stats.stored, zswap_stats.bytes, i / 100, i % 100,
+		zswap_stats.pool_pages, zswap_max_pages);
+	printk("%d pages back from the pool, %d not compressible, "
+		"%d with the pool full\n\r",
+		zswap_stats.loads, zswap_stats.rejected, zswap_stats.pool_full);
+	for_each_task(p) {
+		dir = (unsigned long *) p->tss.cr3;
+		k = 2;	/* task_struct and page directory */
+		for (i = TASK_BASE>>22 ; i<1024 ; i++) {
+			if (!(1&dir[i]))
+				continue;
+			if (dir[i]>HIGH_MEMORY) {
 				printk("page directory[%d]: %08X\n\r",
-					i,pg_dir[i]);
+					i,dir[i]);
 				continue;
 			}
-			if (pg_dir[i]>LOW_MEM)
-				free++,k++;
-			pg_tbl=(unsigned long *) (0xfffff000 & pg_dir[i]);
+			if (dir[i]>LOW_MEM)
+				k++;
+			pg_tbl=(unsigned long *) (0xfffff000 & dir[i]);
 			for(j=0 ; j<1024 ; j++)
 				if ((pg_tbl[j]&1) && pg_tbl[j]>LOW_MEM)
 					if (pg_tbl[j]>HIGH_MEMORY)
 						printk("page_dir[%d][%d]: %08X\n\r",
 							i,j, pg_tbl[j]);
 					else
-						k++,free++;
-		}
-		i++;
-		if (!(i&15) && k) {
-			k++,free++;	/* one page/process for task_struct */
-			printk("Process %d: %d pages\n\r",(i>>4)-1,k);
-			k = 0;
+						k++;
 		}
+		free += k;
+		printk("Process %d: %d pages, %d faults saved by fault-around, "
+			"%d major faults (%d read ahead)\n\r",
+			p->pid,k,p->flt_around,p->maj_flt,p->ra_hits);
 	}
 	printk("Memory found: %d (%d)\n\r",free-shared,total);
 }
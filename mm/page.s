@@ -25,12 +25,15 @@ _page_fault:
 	movl %cr2,%edx
 	pushl %edx
 	pushl %eax
+	call _lock_kernel
+	movl (%esp),%eax
 	testl $1,%eax
 	jne 1f
 	call _do_no_page
 	jmp 2f
 1:	call _do_wp_page
 2:	addl $8,%esp
+	call _unlock_kernel
 	pop %fs
 	pop %es
 	pop %ds
@@ -0,0 +1,273 @@
+/*
+ *  linux/mm/page_alloc.c
+ */
+
+/*
+ * The free pages are kept by a buddy system: free blocks of 2^order
+ * pages, aligned on their size, on one list per order. A block that is
+ * freed is merged with its buddy (the other half of the block twice its
+ * size) if that is free too, and so on upwards. Getting one page is
+ * then just taking the first block off the order-0 list, and only when
+ * that is empty do we split something bigger.
+ *
+ * Whether buddies can be merged is kept in one bit per pair of blocks,
+ * per order: the bit is flipped whenever either of them is allocated or
+ * freed, so it is set exactly when one of the two is free. If flipping
+ * it on a free clears it, the buddy is free as well.
+ *
+ * The list pointers are stored in the free pages themselves. mem_map[]
+ * still counts the users of every allocated page, so copy-on-write
+ * sharing is as before: a page only goes back here when that count
+ * drops to zero.
+ */
+
+#include <string.h>
+
+#include <asm/system.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+
+struct free_block {
+	struct free_block * next, * prev;
+};
+
+static struct free_area {
+	struct free_block list;
+	unsigned char * map;
+	int nr_free;
+} free_area[NR_MEM_ORDERS];
+
+int nr_free_pages = 0;
+
+/*
+ * kswapd is woken when free memory drops below pages_low, and frees
+ * pages until there are pages_high. Only when it can't keep up, and
+ * we get down to pages_min, does get_free_page() swap out itself.
+ */
+int pages_min = 16, pages_low = 32, pages_high = 48;
+
+#define BLOCK(nr) ((struct free_block *) (LOW_MEM + ((nr) << 12)))
+#define BLOCK_NR(b) MAP_NR((unsigned long) (b))
+
+/* flip bit 'nr', and return what it was */
+static inline int togglebit(unsigned char * addr,unsigned int nr)
+{
+	int __res;
+	__asm__ __volatile__("btc %1,%2; adcl $0,%0"
+		:"=g" (__res)
+		:"r" (nr),"m" (*(addr)),"0" (0));
+	return __res;
+}
+
+static inline void add_block(struct free_area * area, struct free_block * b)
+{
+	b->next = area->list.next;
+	b->prev = &area->list;
+	area->list.next->prev = b;
+	area->list.next = b;
+	area->nr_free++;
+}
+
+static inline void remove_block(struct free_area * area, struct free_block * b)
+{
+	b->prev->next = b->next;
+	b->next->prev = b->prev;
+	area->nr_free--;
+}
+
+/*
+ * Give back the block of 2^order pages at map number 'nr'. Called with
+ * interrupts off, and the mem_map[] counts already zero.
+ */
+static void release_block(unsigned long nr, int order)
+{
+	struct free_area * area = free_area + order;
+
+	nr_free_pages += 1 << order;
+	for ( ; order < NR_MEM_ORDERS-1 ; order++, area++) {
+		if (!togglebit(area->map, nr >> (order+1)))
+			break;
+		remove_block(area, BLOCK(nr ^ (1 << order)));
+		nr &= ~(1 << order);
+	}
+	add_block(area, BLOCK(nr));
+}
+
+/*
+ * Get a block of 2^order physically contiguous pages, with a mem_map[]
+ * count of 1 each. It isn't cleared, and this doesn't go looking for
+ * memory to swap out: see get_free_page() for that. Safe at interrupt
+ * level. Returns 0 if there is no free block that big.
+ */
+unsigned long alloc_pages(int order)
+{
+	struct free_area * area;
+	struct free_block * b;
+	unsigned long flags, nr;
+	int o, i;
+
+	if (order < 0 || order >= NR_MEM_ORDERS)
+		return 0;
+	save_flags(flags);
+	cli();
+	for (o = order, area = free_area + o ; o < NR_MEM_ORDERS ; o++, area++)
+		if (area->nr_free)
+			break;
+	if (o == NR_MEM_ORDERS) {
+		restore_flags(flags);
+		return 0;
+	}
+	b = area->list.next;
+	remove_block(area, b);
+	nr = BLOCK_NR(b);
+	if (o < NR_MEM_ORDERS-1)
+		togglebit(area->map, nr >> (o+1));
+/* split it, and put the upper halves back on the smaller lists */
+	while (o > order) {
+		o--;
+		area--;
+		add_block(area, BLOCK(nr + (1 << o)));
+		togglebit(area->map, nr >> (o+1));
+	}
+	nr_free_pages -= 1 << order;
+	for (i = 0 ; i < (1 << order) ; i++) {
+		if (mem_map[nr+i])
+			panic("alloc_pages: free page in use");
+		mem_map[nr+i] = 1;
+	}
+	restore_flags(flags);
+	return LOW_MEM + (nr << 12);
+}
+
+/*
+ * Free a block from alloc_pages(). It has to be the same order it was
+ * gotten with, and is only freed if nobody else shares its first page.
+ */
+void free_pages(unsigned long addr, int order)
+{
+	unsigned long flags, nr;
+	int i;
+
+	if (addr < LOW_MEM)
+		return;
+	if (addr >= HIGH_MEMORY)
+		panic("trying to free nonexistent page");
+	if (addr & ((PAGE_SIZE << order) - 1))
+		panic("free_pages: unaligned block");
+	nr = MAP_NR(addr);
+	if (!mem_map[nr])
+		panic("trying to free free page");
+	save_flags(flags);
+	cli();
+	if (!--mem_map[nr]) {
+		if (page_swap && page_swap[nr])
+			delete_from_swap_cache(addr);
+		for (i = 1 ; i < (1 << order) ; i++)
+			mem_map[nr+i] = 0;
+		release_block(nr, order);
+	}
+	restore_flags(flags);
+}
+
+/*
+ * Free a page of memory at physical address 'addr'. Used by
+ * 'free_page_tables()'
+ */
+void free_page(unsigned long addr)
+{
+	free_pages(addr, 0);
+}
+
+/*
+ * Pages the idle task has cleared already, so that get_free_page()
+ * doesn't have to. They're taken off the free lists only while there
+ * are more than pages_high free, and get used up first, so they never
+ * keep anybody short of memory.
+ */
+#define NR_ZEROED_PAGES 32
+
+static unsigned long zeroed_pages[NR_ZEROED_PAGES];
+static int nr_zeroed_pages = 0;
+
+/*
+ * Called by the idle task: clear one more page for the pool. Returns 0
+ * if there was nothing to do, and the cpu may as well halt.
+ */
+int zero_idle_page(void)
+{
+	unsigned long page;
+
+	if (nr_zeroed_pages >= NR_ZEROED_PAGES || nr_free_pages <= pages_high)
+		return 0;
+	if (!(page = alloc_pages(0)))
+		return 0;
+	__asm__("cld ; rep ; stosl"
+		::"a" (0),"c" (1024),"D" (page)
+		:"cx","di");
+	zeroed_pages[nr_zeroed_pages++] = page;
+	return 1;
+}
+
+/*
+ * Get physical address of a free page, cleared, and mark it used. The
+ * last pages_min pages are kept for when swapping out fails: until then
+ * we swap out ourselves rather than take them. Return 0 only when
+ * there is nothing left at all.
+ */
+unsigned long get_free_page(void)
+{
+	unsigned long page;
+
+	if (nr_zeroed_pages)
+		return zeroed_pages[--nr_zeroed_pages];
+	for (;;) {
+		if (nr_free_pages < pages_low)
+			wake_up(&kswapd_wait);
+		if (nr_free_pages > pages_min && (page = alloc_pages(0)))
+			break;
+		reclaim_stats.direct++;
+		if (swap_out())
+			continue;
+		if ((page = alloc_pages(0)))
+			break;
+		return 0;
+	}
+	__asm__("cld ; rep ; stosl"
+		::"a" (0),"c" (1024),"D" (page)
+		:"cx","di");
+	return page;
+}
+
+/*
+ * Set up the empty free lists, with the bitmaps (one bit per pair of
+ * blocks) taken from 'start_mem'. mem_init() then frees the pages of
+ * main memory one by one, which builds up the bigger blocks as it goes.
+ */
+unsigned long free_area_init(unsigned long start_mem)
+{
+	int order, size;
+
+	for (order = 0 ; order < NR_MEM_ORDERS ; order++) {
+		free_area[order].list.next = free_area[order].list.prev =
+			&free_area[order].list;
+		free_area[order].nr_free = 0;
+		free_area[order].map = (unsigned char *) start_mem;
+	/* the last page's pair bit too, when the pages don't pair up evenly */
+		size = (((paging_pages-1) >> (order+1)) + 1 + 31) / 32 * 4;
+		memset((void *) start_mem, 0, size);
+		start_mem += size;
+	}
+	return start_mem;
+}
+
+void show_free_areas(void)
+{
+	int order;
+
+	printk("Free pages: %d (", nr_free_pages);
+	for (order = 0 ; order < NR_MEM_ORDERS ; order++)
+		printk(" %d*%dkB", free_area[order].nr_free, 4 << order);
+	printk(" ) %d cleared in advance\n\r", nr_zeroed_pages);
+}
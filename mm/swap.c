@@ -9,14 +9,18 @@
  * Started 18.12.91
  */
 
+#include <errno.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <linux/mm.h>
 #include <linux/sched.h>
 #include <linux/head.h>
 #include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/swap.h>
 
-#define SWAP_BITS (4096<<3)
+#define SWAP_BITS (4096<<3)	/* the pages the header's bitmap has room for */
 
 #define bitop(name,op) \
 static inline int name(char * addr,unsigned int nr) \
@@ -32,91 +36,666 @@ bitop(bit,"")
 bitop(setbit,"s")
 bitop(clrbit,"r")
 
-static char * swap_bitmap = NULL;
 int SWAP_DEV = 0;
 
+/*
+ * There can be several swap areas, each a partition or a regular file,
+ * added with swapon(). Each has the usual header page, whose bitmap of
+ * free pages we start from. New swap space comes from the area of the
+ * highest priority that has any left: swap_list is the list of them,
+ * highest first, through swap_info[].next.
+ *
+ * What a page table has for a page that is out is a swap entry, shifted
+ * up a bit: the area in the top bits, and the page in that area in the
+ * rest. Page 0 of every area is the header, so no entry is 0.
+ */
+#define MAX_SWAPFILES 8
+
+#define SWP_TYPE(entry) ((entry) >> 24)
+#define SWP_OFFSET(entry) ((entry) & 0xffffff)
+#define SWP_ENTRY(type,offset) (((type) << 24) | (offset))
+
+#define SWP_USED	1
+#define SWP_WRITEOK	3	/* used, and we can put new pages there */
+
+/*
+ * The tables of an area have an entry per page, and each is one block
+ * from alloc_pages(). The swap cache and zmap[] take 4 bytes a page, so
+ * they are what limits the size of an area.
+ */
+#define MAX_SWAP_PAGES (PAGE_SIZE << (NR_MEM_ORDERS-3))
+
+static struct swap_info_struct {
+	int flags;
+	int dev;			/* the partition, or the file's device */
+	struct m_inode * swap_file;	/* NULL for a partition */
+	int prio;
+	int pages;			/* header included */
+	int next_byte;			/* of the bitmap, for the next search */
+	int nr_free;
+	char * bitmap;			/* of free pages, a bit a page */
+	unsigned char * swap_map;
+	unsigned long * swap_cache;
+	unsigned long * zmap;		/* compressed copies, see zswap.c */
+	int map_order;			/* of swap_map: see bitmap_order() */
+	int next;			/* next lower priority area, or -1 */
+} swap_info[MAX_SWAPFILES];
+
+/*
+ * swap_cache[] and zmap[] are of map_order+2. The bitmap has a bit where
+ * swap_map[] has a byte, but takes a page at least.
+ */
+#define bitmap_order(p) ((p)->map_order > 3 ? (p)->map_order - 3 : 0)
+
+static int swap_list = -1;
+static int nr_swapfiles = 0;
+static int least_priority = 0;
+static int nr_free_swap = 0;		/* in the areas we can write to */
+
+/*
+ * The swap cache. A page that was read in from swap keeps its swap page
+ * as long as it stays clean, so that it can just be dropped when it is
+ * picked to go out again. swap_cache[] has the page cached for each swap
+ * page, page_swap[] (by mem_map index) the swap entry of a cached page.
+ * Cached pages are mapped read-only: the first write goes through
+ * un_wp_page(), which takes the page out of the cache.
+ *
+ * As page tables that went through fork() can share a swap page, and
+ * the cache holds on to one too, every swap page in use has a count in
+ * swap_map[]. It goes back on the bitmap when that drops to zero.
+ */
+#define swap_count(entry) \
+(swap_info[SWP_TYPE(entry)].swap_map[SWP_OFFSET(entry)])
+#define swap_cached(entry) \
+(swap_info[SWP_TYPE(entry)].swap_cache[SWP_OFFSET(entry)])
+
+/*
+ * A swap page whose contents went to the compressed pool instead of the
+ * disk has its handle there in zmap[]. It keeps it until the swap page
+ * is freed.
+ */
+#define swap_zmap(entry) \
+(swap_info[SWP_TYPE(entry)].zmap[SWP_OFFSET(entry)])
+
+/* the area of a swap entry, or NULL if it isn't one */
+static struct swap_info_struct * swap_area(unsigned long entry)
+{
+	struct swap_info_struct * p;
+
+	if (SWP_TYPE(entry) >= nr_swapfiles)
+		return NULL;
+	p = swap_info + SWP_TYPE(entry);
+	if (!(p->flags & SWP_USED) || !SWP_OFFSET(entry) ||
+	    SWP_OFFSET(entry) >= p->pages)
+		return NULL;
+	return p;
+}
+
 /*
  * We never page the pages in task[0] - kernel memory.
- * We page all other pages.
+ * We page all other pages: the TASK_SIZE at TASK_BASE in the page
+ * directory of every task.
+ */
+#define FIRST_VM_DIR (TASK_BASE>>22)
+#define LAST_VM_DIR ((TASK_BASE+TASK_SIZE-1)>>22)
+#define VM_DIRS (TASK_SIZE>>22)
+
+/*
+ * Swap space is handed out in clusters of SWAP_CLUSTER pages, which are
+ * one byte of the bitmap each: a byte of all ones is a free cluster.
+ * swap_out() fills one with the dirty pages it picks and writes them
+ * out in a single request. Both clusters and single pages are searched
+ * for from where the last search of that area ended (next-fit), and
+ * nr_free_swap keeps us from searching at all when there's no hope.
  */
-#define FIRST_VM_PAGE (TASK_SIZE>>12)
-#define LAST_VM_PAGE (1024*1024)
-#define VM_PAGES (LAST_VM_PAGE - FIRST_VM_PAGE)
+#define SWAP_CLUSTER_ORDER 3
+#define SWAP_CLUSTER (1<<SWAP_CLUSTER_ORDER)
+
+static char * cluster_buf = NULL;	/* the pages of the cluster, copied */
+static int cluster_base = 0;		/* first page of the cluster */
+static int cluster_count = 0;		/* pages in cluster_buf */
+static int cluster_writing = 0;		/* cluster_buf is on its way out */
+
+/* the area new swap pages come from: returns -1 if there's no room */
+static int swap_target(void)
+{
+	int type;
+
+	if (!nr_free_swap)
+		return -1;
+	for (type = swap_list ; type >= 0 ; type = swap_info[type].next)
+		if (swap_info[type].nr_free)
+			return type;
+	return -1;
+}
 
 static int get_swap_page(void)
 {
-	int nr;
+	struct swap_info_struct * p;
+	int i, byte, bits, nr, bytes, type;
+
+	if ((type = swap_target()) < 0)
+		return 0;
+	p = swap_info + type;
+	bytes = (p->pages + 7) >> 3;
+	for (i = 0, byte = p->next_byte ; i < bytes ; i++, byte++) {
+		if (byte >= bytes)
+			byte = 0;
+		if (!(bits = (unsigned char) p->bitmap[byte]))
+			continue;
+		__asm__("bsfl %1,%0":"=r" (nr):"r" (bits));
+		nr += byte << 3;
+		clrbit(p->bitmap,nr);
+		p->swap_map[nr] = 1;
+		p->nr_free--;
+		nr_free_swap--;
+		p->next_byte = byte;
+		return SWP_ENTRY(type,nr);
+	}
+	return 0;
+}
+
+/*
+ * A whole free cluster, or 0. It has to be in the area get_swap_page()
+ * would use, or the priorities mean nothing.
+ */
+static int get_swap_cluster(void)
+{
+	struct swap_info_struct * p;
+	int i, byte, nr, bytes, type;
 
-	if (!swap_bitmap)
+	if ((type = swap_target()) < 0)
 		return 0;
-	for (nr = 1; nr < 32768 ; nr++)
-		if (clrbit(swap_bitmap,nr))
-			return nr;
+	p = swap_info + type;
+	if (p->nr_free < SWAP_CLUSTER)
+		return 0;
+	bytes = (p->pages + 7) >> 3;
+	for (i = 0, byte = p->next_byte ; i < bytes ; i++, byte++) {
+		if (byte >= bytes)
+			byte = 0;
+		if ((unsigned char) p->bitmap[byte] != 0xff)
+			continue;
+		p->bitmap[byte] = 0;
+		for (nr = byte << 3 ; nr < (byte+1) << 3 ; nr++)
+			p->swap_map[nr] = 1;
+		p->nr_free -= SWAP_CLUSTER;
+		nr_free_swap -= SWAP_CLUSTER;
+		p->next_byte = byte + 1;
+		return SWP_ENTRY(type, byte << 3);
+	}
 	return 0;
 }
 
-void swap_free(int swap_nr)
+void swap_free(int entry)
 {
-	if (!swap_nr)
+	struct swap_info_struct * p;
+
+	if (!entry)
 		return;
-	if (swap_bitmap && swap_nr < SWAP_BITS)
-		if (!setbit(swap_bitmap,swap_nr))
+	if ((p = swap_area(entry)) && p->swap_map[SWP_OFFSET(entry)]) {
+		if (--p->swap_map[SWP_OFFSET(entry)])
+			return;
+		if (p->zmap[SWP_OFFSET(entry)]) {
+			zswap_free(p->zmap[SWP_OFFSET(entry)]);
+			p->zmap[SWP_OFFSET(entry)] = 0;
+		}
+		if (!setbit(p->bitmap,SWP_OFFSET(entry))) {
+			p->nr_free++;
+			if (p->flags == SWP_WRITEOK)
+				nr_free_swap++;
 			return;
+		}
+	}
 	printk("Swap-space bad (swap_free())\n\r");
 	return;
 }
 
-void swap_in(unsigned long *table_ptr)
+/* another page table entry for 'entry': returns 0 if it can't have one */
+int swap_duplicate(int entry)
+{
+	if (!swap_area(entry) || !swap_count(entry) || swap_count(entry) == 255)
+		return 0;
+	swap_count(entry)++;
+	return 1;
+}
+
+static void add_to_swap_cache(unsigned long page, int entry)
 {
-	int swap_nr;
-	unsigned long page;
+	swap_cached(entry) = page;
+	page_swap[MAP_NR(page)] = entry;
+	swap_count(entry)++;
+}
 
-	if (!swap_bitmap) {
-		printk("Trying to swap in without swap bit-map");
+/*
+ * The page is about to be written to, or nobody uses it any more: its
+ * swap page is no longer a copy of it. Called from interrupts too, by
+ * way of free_page().
+ */
+void delete_from_swap_cache(unsigned long page)
+{
+	unsigned long entry = page_swap[MAP_NR(page)];
+
+	if (!entry)
 		return;
+	page_swap[MAP_NR(page)] = 0;
+	swap_cached(entry) = 0;
+	swap_free(entry);
+}
+
+/*
+ * Read or write 'nr' pages of swap space, from 'entry' on, to or from
+ * 'buf'. A partition does it in one request. A swap file's blocks can
+ * be anywhere on its device: we bmap() them, and send every run of
+ * them that is contiguous on the disk as a request of its own.
+ */
+#define BLOCKS_PER_PAGE (PAGE_SIZE / BLOCK_SIZE)
+
+static void rw_swap_pages(int rw, int entry, int nr, char * buf)
+{
+	struct swap_info_struct * p = swap_info + SWP_TYPE(entry);
+	int block, last, first, count, b;
+
+	if (!p->swap_file) {
+		ll_rw_pages(rw, p->dev, SWP_OFFSET(entry), nr, buf);
+		return;
+	}
+	block = SWP_OFFSET(entry) * BLOCKS_PER_PAGE;
+	last = block + nr * BLOCKS_PER_PAGE;
+	first = count = 0;
+	for ( ; block < last ; block++) {
+		b = bmap(p->swap_file, block);
+		if (count && b == first + count) {
+			count++;
+			continue;
+		}
+		if (count) {
+			ll_rw_blocks(rw, p->dev, first, count, buf);
+			buf += count * BLOCK_SIZE;
+		}
+		first = b;
+		count = 1;
+		if (!b) {
+			printk("swap file has a hole: block %d\n\r", block);
+			buf += BLOCK_SIZE;
+			count = 0;
+		}
 	}
+	if (count)
+		ll_rw_blocks(rw, p->dev, first, count, buf);
+}
+
+void read_swap_page(int entry, char * buf)
+{
+	if (swap_zmap(entry))
+		zswap_load(swap_zmap(entry), (unsigned long) buf);
+	else
+		rw_swap_pages(READ, entry, 1, buf);
+}
+
+/*
+ * Write out the cluster swap_out() has been filling, and give back the
+ * part of it that wasn't used. The pages in it are gone already, and
+ * their page tables point at the swap space: anybody who faults on
+ * them before this is done reads them after it, as swap requests are
+ * done in the order they were made.
+ */
+static void write_swap_cluster(void)
+{
+	int i;
+
+	if (!cluster_base || cluster_writing)
+		return;
+	for (i = cluster_count ; i < SWAP_CLUSTER ; i++)
+		swap_free(cluster_base + i);
+	if (cluster_count) {
+		cluster_writing = 1;
+		rw_swap_pages(WRITE,cluster_base,cluster_count,cluster_buf);
+		reclaim_stats.swap_writes++;
+		cluster_writing = 0;
+	}
+	cluster_base = cluster_count = 0;
+}
+
+/*
+ * Swap readahead. A task that comes back after being swapped out
+ * faults its pages in one by one, but swap_out() wrote them out in
+ * clusters, in the order it found them: so when we have to go to the
+ * disk anyway, we read the other used pages of the aligned window
+ * around the one we want in the same request, and put them in the swap
+ * cache. They sit in ra_pages[], holding the only reference to them,
+ * until somebody maps them (a hit) or they are pushed out by newer ones
+ * or by swap_out() (a miss).
+ *
+ * The window doubles, up to a cluster, while at least half of what we
+ * read ahead gets used before the next read, and halves when none of it
+ * does. We don't read ahead when memory is short.
+ */
+#define RA_PAGES 32
+
+static unsigned long ra_pages[RA_PAGES];
+static int ra_next = 0;			/* the oldest one, and the next free */
+static int ra_window = 4;
+static int ra_read = 0;			/* pages read ahead last time */
+static int ra_used = 0;			/* ... and how many of them were used */
+
+static void ra_drop(int i)
+{
+	unsigned long page = ra_pages[i];
+
+	ra_pages[i] = 0;
+	free_page(page);
+	reclaim_stats.ra_misses++;
+}
+
+static void ra_add(unsigned long page)
+{
+	if (ra_pages[ra_next])
+		ra_drop(ra_next);
+	ra_pages[ra_next] = page;
+	ra_next = (ra_next + 1) % RA_PAGES;
+}
+
+/* a page just found in the swap cache: returns 1 if it was read ahead */
+static int ra_take(unsigned long page)
+{
+	int i;
+
+	for (i = 0 ; i < RA_PAGES ; i++)
+		if (ra_pages[i] == page) {
+			ra_pages[i] = 0;
+			ra_used++;
+			reclaim_stats.ra_hits++;
+			return 1;
+		}
+	return 0;
+}
+
+/* free up to 'nr' pages that were read ahead and never used, oldest first */
+static int shrink_readahead(int nr)
+{
+	int i, freed = 0;
+
+	for (i = 0 ; i < RA_PAGES && freed < nr ; i++)
+		if (ra_pages[(ra_next + i) % RA_PAGES]) {
+			ra_drop((ra_next + i) % RA_PAGES);
+			freed++;
+		}
+	return freed;
+}
+
+static void map_cached_page(unsigned long * table_ptr, int swap_nr,
+	unsigned long page)
+{
+	if (!ra_take(page))
+		mem_map[MAP_NR(page)]++;
+	swap_free(swap_nr);
+	*table_ptr = page | 5;
+}
+
+/* can swap page 'nr' be read ahead? Not if it might not be written yet */
+static inline int ra_wanted(int nr)
+{
+	if (SWP_OFFSET(nr) >= swap_info[SWP_TYPE(nr)].pages)
+		return 0;
+	if (!swap_count(nr) || swap_count(nr) == 255 || swap_cached(nr))
+		return 0;
+	if (swap_zmap(nr))		/* nothing on the disk */
+		return 0;
+	if (cluster_base && nr >= cluster_base && nr < cluster_base + SWAP_CLUSTER)
+		return 0;
+	return 1;
+}
+
+/*
+ * Bring back the page 'table_ptr' points to. If it's in the swap cache
+ * we just map that, read-only. Otherwise it is read in, and goes into
+ * the cache too, unless we are about to write to it anyway and nobody
+ * else has the swap page: then it goes back to how it always was.
+ */
+void swap_in(unsigned long *table_ptr, int write_access)
+{
+	int swap_nr, nr, first, last, order;
+	unsigned long page, block;
+	unsigned char pinned = 0;
+
 	if (1 & *table_ptr) {
 		printk("trying to swap in present page\n\r");
 		return;
 	}
 	swap_nr = *table_ptr >> 1;
-	if (!swap_nr) {
+	if (!swap_area(swap_nr)) {
 		printk("No swap page in swap_in\n\r");
 		return;
 	}
-	if (!(page = get_free_page()))
-		oom();
-	read_swap_page(swap_nr, (char *) page);
-	if (setbit(swap_bitmap,swap_nr))
-		printk("swapping in multiply from same page\n\r");
-	*table_ptr = page | (PAGE_DIRTY | 7);
+	if ((page = swap_cached(swap_nr))) {
+		map_cached_page(table_ptr, swap_nr, page);
+		reclaim_stats.cache_hits++;
+		return;
+	}
+/* in the compressed pool: no disk, so no reading ahead either */
+	if (swap_zmap(swap_nr)) {
+		if (!(page = get_free_page()))
+			oom();
+	/* we may have slept: the swap page and its handle may be gone */
+		if (*table_ptr != (swap_nr << 1) || !swap_zmap(swap_nr)) {
+			free_page(page);
+			return;
+		}
+		zswap_load(swap_zmap(swap_nr), page);
+		goto got_page;
+	}
+	if (ra_read) {
+		if (ra_used * 2 >= ra_read && ra_window < SWAP_CLUSTER)
+			ra_window <<= 1;
+		else if (!ra_used && ra_window > 2)
+			ra_window >>= 1;
+	}
+	ra_read = ra_used = 0;
+/*
+ * The pages we read ahead get a count on their swap page first, so
+ * nobody can free it and use it for something else while we sleep.
+ */
+	first = last = swap_nr;
+	if (nr_free_pages > pages_low + ra_window)
+		for (nr = swap_nr & ~(ra_window-1) ; nr < (swap_nr | (ra_window-1)) + 1 ; nr++) {
+			if (nr == swap_nr || !ra_wanted(nr))
+				continue;
+			swap_count(nr)++;
+			pinned |= 1 << (nr & (SWAP_CLUSTER-1));
+			if (nr < first)
+				first = nr;
+			last = nr;
+		}
+	for (order = 0 ; (1 << order) < last - first + 1 ; order++)
+		/* nothing */;
+	if (pinned && !(block = alloc_pages(order))) {
+		for (nr = first ; nr <= last ; nr++)
+			if (pinned & (1 << (nr & (SWAP_CLUSTER-1))))
+				swap_free(nr);
+		pinned = 0;
+		first = last = swap_nr;
+	}
+	if (!pinned) {
+		if (!(block = get_free_page()))
+			oom();
+		order = 0;
+	}
+/* the tail of the block isn't needed: nor are the free pages in it */
+	for (nr = last + 1 ; nr < first + (1 << order) ; nr++)
+		free_page(block + ((nr - first) << 12));
+	rw_swap_pages(READ, first, last - first + 1, (char *) block);
+	for (nr = first ; nr <= last ; nr++) {
+		page = block + ((nr - first) << 12);
+		if (nr == swap_nr)
+			continue;
+		if (!(pinned & (1 << (nr & (SWAP_CLUSTER-1))))) {
+			free_page(page);
+			continue;
+		}
+		if (swap_cached(nr)) {
+			free_page(page);
+			swap_free(nr);
+			continue;
+		}
+/* the count we took is the swap cache's now */
+		swap_cached(nr) = page;
+		page_swap[MAP_NR(page)] = nr;
+		ra_add(page);
+		ra_read++;
+	}
+	page = block + ((swap_nr - first) << 12);
+got_page:
+/*
+ * The page table may be shared after a fork(), and another task may
+ * have brought the page in through it while we slept (or swapoff() may
+ * have): then the entry isn't ours to change any more.
+ */
+	if (*table_ptr != (swap_nr << 1)) {
+		free_page(page);
+		return;
+	}
+/* somebody sharing the swap page may have read it in while we slept */
+	if (swap_cached(swap_nr)) {
+		free_page(page);
+		map_cached_page(table_ptr, swap_nr, swap_cached(swap_nr));
+		return;
+	}
+	if (write_access && swap_count(swap_nr) == 1) {
+		swap_free(swap_nr);
+		*table_ptr = page | (PAGE_DIRTY | 7);
+		return;
+	}
+	add_to_swap_cache(page, swap_nr);
+	swap_free(swap_nr);
+	*table_ptr = page | 5;
+}
+
+struct reclaim_stats reclaim_stats = {0, };
+
+/*
+ * We changed the page table entry at 'table_ptr', for 'address'. The
+ * TLB only has entries for the page directory we run with, and the
+ * others went when they were last switched to, so it only needs a flush
+ * if that table is in ours: it may be in more than one directory, after
+ * a fork() or vfork().
+ */
+static inline void flush_swapped(unsigned long * table_ptr,
+	unsigned long address)
+{
+	if ((0xfffff000 & *PAGE_DIR_OFFSET(current->tss.cr3,address)) ==
+	    (0xfffff000 & (unsigned long) table_ptr))
+		invalidate_page(address);
+}
+
+/*
+ * Is the page table 'pg_table', at 'dir_entry' in the directories, in
+ * use on another cpu? Its TLB may have entries from it that only we
+ * could flush, so swap_out() leaves such a table alone for now. Tasks
+ * are only switched to with the kernel lock held, which we have, so a
+ * table that isn't in use elsewhere won't be before we let go.
+ */
+static int table_in_use_elsewhere(unsigned long pg_table, int dir_entry)
+{
+	int cpu;
+
+	for (cpu = 0 ; cpu < smp_num_cpus ; cpu++) {
+		if (cpu == smp_processor_id())
+			continue;
+		if ((0xfffff000 & ((unsigned long *)
+		    current_set[cpu]->tss.cr3)[dir_entry]) == pg_table)
+			return 1;
+	}
+	return 0;
 }
 
-int try_to_swap_out(unsigned long * table_ptr)
+/*
+ * A page that has been used since we last came by gets a second
+ * chance: we clear its accessed bit and leave it. It goes the next
+ * time round if nobody has touched it in between. The bit may still be
+ * set in the TLB, in which case the cpu won't set it again: so that's
+ * flushed too.
+ *
+ * Dirty pages go to the compressed pool if they fit there, else into
+ * the current cluster if there is one to be had, or are written out on
+ * their own if not. Returns 1 if the page was freed, 2 if it was freed
+ * but we had to sleep on the write.
+ */
+int try_to_swap_out(unsigned long * table_ptr, unsigned long address)
 {
-	unsigned long page;
+	unsigned long page, handle;
 	unsigned long swap_nr;
 
 	page = *table_ptr;
 	if (!(PAGE_PRESENT & page))
 		return 0;
-	if (page - LOW_MEM > PAGING_MEMORY)
+	if ((page & 0xfffff000) < LOW_MEM || page >= HIGH_MEMORY)
 		return 0;
+	reclaim_stats.scanned++;
+	if (PAGE_ACCESSED & page) {
+		*table_ptr = page & ~PAGE_ACCESSED;
+		flush_swapped(table_ptr, address);
+		reclaim_stats.referenced++;
+		return 0;
+	}
 	if (PAGE_DIRTY & page) {
 		page &= 0xfffff000;
 		if (mem_map[MAP_NR(page)] != 1)
 			return 0;
+		if (nr_free_swap && (handle = zswap_store(page))) {
+			if (!(swap_nr = get_swap_page())) {
+				zswap_free(handle);
+				return 0;
+			}
+			swap_zmap(swap_nr) = handle;
+			*table_ptr = swap_nr<<1;
+			flush_swapped(table_ptr, address);
+			free_page(page);
+			reclaim_stats.reclaimed++;
+			return 1;
+		}
+		if (!cluster_writing && cluster_buf && cluster_count < SWAP_CLUSTER &&
+		    (cluster_base || (cluster_base = get_swap_cluster()))) {
+			swap_nr = cluster_base + cluster_count;
+			copy_page(page, cluster_buf + (cluster_count++ << 12));
+			*table_ptr = swap_nr<<1;
+			flush_swapped(table_ptr, address);
+			free_page(page);
+			reclaim_stats.reclaimed++;
+			reclaim_stats.swapped++;
+			return 1;
+		}
 		if (!(swap_nr = get_swap_page()))
 			return 0;
 		*table_ptr = swap_nr<<1;
-		invalidate();
-		write_swap_page(swap_nr, (char *) page);
+		flush_swapped(table_ptr, address);
+		rw_swap_pages(WRITE, swap_nr, 1, (char *) page);
 		free_page(page);
+		reclaim_stats.reclaimed++;
+		reclaim_stats.swapped++;
+		reclaim_stats.swap_writes++;
+		return 2;
+	}
+/*
+ * Clean and in the swap cache: it's on disk already. Unless swapoff()
+ * is taking that area away, and wants it in memory.
+ */
+	page &= 0xfffff000;
+	if ((swap_nr = page_swap[MAP_NR(page)])) {
+		if (swap_info[SWP_TYPE(swap_nr)].flags != SWP_WRITEOK)
+			return 0;
+		if (!swap_duplicate(swap_nr))
+			return 0;
+		*table_ptr = swap_nr<<1;
+		flush_swapped(table_ptr, address);
+		free_page(page);
+		reclaim_stats.reclaimed++;
+		reclaim_stats.cache_drops++;
 		return 1;
 	}
 	*table_ptr = 0;
-	invalidate();
+	flush_swapped(table_ptr, address);
 	free_page(page);
+	reclaim_stats.reclaimed++;
 	return 1;
 }
 
@@ -124,130 +703,416 @@ int try_to_swap_out(unsigned long * table_ptr)
  * Ok, this has a rather intricate logic - the idea is to make good
  * and fast machine code. If we didn't worry about that, things would
  * be easier.
+ *
+ * We go round the page directories of all the tasks, and carry on
+ * where we stopped the last time. The task is remembered by pid, as it
+ * may be gone by then: if so, we start over with the first one. This is
+ * the hand of the clock: it may have to go round twice, once to clear
+ * the accessed bits and once to find a page that stayed unused.
+ * *
+ * Pages that were read ahead and never used go first, as they cost no
+ * I/O to drop. We free up to a cluster of pages at a time, and return
+ * how many. We stop early if we had to sleep, as the task we were
+ * looking at may be gone when we wake up.
  */
 int swap_out(void)
 {
-	static int dir_entry = FIRST_VM_PAGE>>10;
+	static long swap_pid = 0;
+	static int dir_entry = FIRST_VM_DIR;
 	static int page_entry = -1;
-	int counter = VM_PAGES;
-	int pg_table;
+	struct task_struct * p;
+	int counter = 2 * (nr_tasks+1) * VM_DIRS; /* directory entries to look at */
+	unsigned long pg_table;
+	int freed, r;
 
-	while (counter>0) {
-		pg_table = pg_dir[dir_entry];
-		if (pg_table & 1)
-			break;
-		counter -= 1024;
-		dir_entry++;
-		if (dir_entry >= 1024)
-			dir_entry = FIRST_VM_PAGE>>10;
-	}
-	pg_table &= 0xfffff000;
-	while (counter-- > 0) {
-		page_entry++;
-		if (page_entry >= 1024) {
-			page_entry = 0;
-		repeat:
-			dir_entry++;
-			if (dir_entry >= 1024)
-				dir_entry = FIRST_VM_PAGE>>10;
-			pg_table = pg_dir[dir_entry];
-			if (!(pg_table&1))
-				if ((counter -= 1024) > 0)
-					goto repeat;
-				else
-					break;
+	if ((freed = shrink_readahead(SWAP_CLUSTER)) >= SWAP_CLUSTER)
+		return freed;
+	if (!(p = find_task_by_pid(swap_pid))) {
+		p = init_task.task.next_task;
+		dir_entry = FIRST_VM_DIR;
+		page_entry = -1;
+	}
+	while (counter > 0 && p != &init_task.task) {
+		pg_table = ((unsigned long *) p->tss.cr3)[dir_entry];
+		if ((pg_table & 1) &&
+		    !table_in_use_elsewhere(pg_table & 0xfffff000, dir_entry)) {
 			pg_table &= 0xfffff000;
+			while (++page_entry < 1024)
+				if ((r = try_to_swap_out(page_entry +
+				    (unsigned long *) pg_table,
+				    (dir_entry << 22) | (page_entry << 12)))) {
+					swap_pid = p->pid;
+					if (++freed >= SWAP_CLUSTER || r == 2)
+						goto out;
+				}
+		}
+		counter--;
+		page_entry = -1;
+		if (++dir_entry > LAST_VM_DIR) {
+			dir_entry = FIRST_VM_DIR;
+			if ((p = p->next_task) == &init_task.task)
+				p = p->next_task;
 		}
-		if (try_to_swap_out(page_entry + (unsigned long *) pg_table))
-			return 1;
 	}
-	printk("Out of swap-memory\n\r");
-	return 0;
+	if (!freed) {
+		swap_pid = 0;
+		printk("Out of swap-memory\n\r");
+	}
+out:
+	write_swap_cluster();
+	return freed;
 }
 
+struct wait_queue * kswapd_wait = NULL;
+
 /*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
+ * kswapd keeps some memory free ahead of demand, so that whoever needs
+ * a page doesn't have to wait for a swap write to get it. It sleeps
+ * until get_free_page() finds fewer than pages_low pages free, and then
+ * frees them until there are pages_high. If swap_out() finds nothing,
+ * it gives the disk a second before looking again.
+ *
+ * It runs in the kernel, so nobody pre-empts it: it has to let the
+ * others in itself, when its slice is used up or a real-time task
+ * wants the CPU. Signals mean nothing to it.
  */
-unsigned long get_free_page(void)
+static void kswapd(void)
 {
-register unsigned long __res asm("ax");
+	int cpu;
 
-repeat:
-	__asm__("std ; repne ; scasb\n\t"
-		"jne 1f\n\t"
-		"movb $1,1(%%edi)\n\t"
-		"sall $12,%%ecx\n\t"
-		"addl %2,%%ecx\n\t"
-		"movl %%ecx,%%edx\n\t"
-		"movl $1024,%%ecx\n\t"
-		"leal 4092(%%edx),%%edi\n\t"
-		"rep ; stosl\n\t"
-		"movl %%edx,%%eax\n"
-		"1:"
-		:"=a" (__res)
-		:"0" (0),"i" (LOW_MEM),"c" (PAGING_PAGES),
-		"D" (mem_map+PAGING_PAGES-1)
-		:"di","cx","dx");
-	if (__res >= HIGH_MEMORY)
-		goto repeat;
-	if (!__res && swap_out())
-		goto repeat;
-	return __res;
+	for (;;) {
+		current->signal = 0;
+		interruptible_sleep_on(&kswapd_wait);
+		reclaim_stats.kswapd++;
+		while (nr_free_pages < pages_high) {
+			if (!swap_out()) {
+				current->signal = 0;
+				interruptible_sleep_on_timeout(&kswapd_wait, HZ);
+				break;
+			}
+			cpu = smp_processor_id();
+			if (!current->counter || need_resched[cpu])
+				schedule();
+		}
+	}
 }
 
-void init_swapping(void)
+/* put area 'type' on swap_list, after those of the same priority */
+static void enable_swap_area(int type)
+{
+	struct swap_info_struct * p = swap_info + type;
+	int * link = &swap_list;
+
+	while (*link >= 0 && swap_info[*link].prio >= p->prio)
+		link = &swap_info[*link].next;
+	p->next = *link;
+	*link = type;
+	p->flags = SWP_WRITEOK;
+	nr_free_swap += p->nr_free;
+}
+
+static void disable_swap_area(int type)
+{
+	struct swap_info_struct * p = swap_info + type;
+	int * link = &swap_list;
+
+	while (*link != type)
+		link = &swap_info[*link].next;
+	*link = p->next;
+	p->flags = SWP_USED;
+	nr_free_swap -= p->nr_free;
+}
+
+static void free_swap_area(struct swap_info_struct * p)
+{
+	if (p->bitmap)
+		free_pages((long) p->bitmap, bitmap_order(p));
+	if (p->swap_map)
+		free_pages((long) p->swap_map, p->map_order);
+	if (p->swap_cache)
+		free_pages((long) p->swap_cache, p->map_order + 2);
+	if (p->zmap)
+		free_pages((long) p->zmap, p->map_order + 2);
+	if (p->swap_file)
+		iput(p->swap_file);
+	p->bitmap = NULL;
+	p->swap_map = NULL;
+	p->swap_cache = NULL;
+	p->zmap = NULL;
+	p->swap_file = NULL;
+	p->flags = 0;
+}
+
+/*
+ * Start swapping to the partition 'dev', or to the file 'inode' on it.
+ * The inode is the area's from now on, if this works.
+ */
+static int add_swap_area(int dev, struct m_inode * inode, int prio)
 {
 	extern int *blk_size[];
-	int swap_size,i,j;
+	struct swap_info_struct * p;
+	int type,swap_size,i,j;
+	char * header;
 
-	if (!SWAP_DEV)
-		return;
-	if (!blk_size[MAJOR(SWAP_DEV)]) {
+	for (type = 0 ; type < nr_swapfiles ; type++) {
+		p = swap_info + type;
+		if (!(p->flags & SWP_USED))
+			continue;
+		if (inode ? p->swap_file == inode : !p->swap_file && p->dev == dev)
+			return -EBUSY;
+	}
+	for (type = 0 ; type < nr_swapfiles ; type++)
+		if (!(swap_info[type].flags & SWP_USED))
+			break;
+	if (type >= MAX_SWAPFILES)
+		return -EPERM;
+	if (type == nr_swapfiles)
+		nr_swapfiles++;
+	p = swap_info + type;
+	p->flags = SWP_USED;
+	p->dev = dev;
+	p->swap_file = NULL;
+	p->prio = prio;
+	p->next_byte = 0;
+	p->bitmap = NULL;
+	p->swap_map = NULL;
+	p->swap_cache = NULL;
+	p->zmap = NULL;
+	if (inode)
+		swap_size = inode->i_size / BLOCK_SIZE;
+	else if (blk_size[MAJOR(dev)])
+		swap_size = blk_size[MAJOR(dev)][MINOR(dev)];
+	else {
 		printk("Unable to get size of swap device\n\r");
-		return;
+		p->flags = 0;
+		return -EINVAL;
 	}
-	swap_size = blk_size[MAJOR(SWAP_DEV)][MINOR(SWAP_DEV)];
-	if (!swap_size)
-		return;
 	if (swap_size < 100) {
 		printk("Swap device too small (%d blocks)\n\r",swap_size);
-		return;
+		p->flags = 0;
+		return -EINVAL;
 	}
 	swap_size >>= 2;
-	if (swap_size > SWAP_BITS)
-		swap_size = SWAP_BITS;
-	swap_bitmap = (char *) get_free_page();
-	if (!swap_bitmap) {
-		printk("Unable to start swapping: out of memory :-)\n\r");
-		return;
+	if (swap_size > MAX_SWAP_PAGES)
+		swap_size = MAX_SWAP_PAGES;
+	p->pages = swap_size;
+	if (inode) {
+		for (i = 0 ; i < swap_size * BLOCKS_PER_PAGE ; i++)
+			if (!bmap(inode, i)) {
+				printk("Swap file has holes\n\r");
+				p->flags = 0;
+				return -EINVAL;
+			}
+		p->swap_file = inode;
 	}
-	read_swap_page(0,swap_bitmap);
-	if (strncmp("SWAP-SPACE",swap_bitmap+4086,10)) {
+/* the bitmap, use counts and the swap cache, one entry per swap page */
+	for (i = 0 ; (PAGE_SIZE << i) < swap_size ; i++)
+		/* nothing */;
+	p->map_order = i;
+	p->bitmap = (char *) alloc_pages(bitmap_order(p));
+	p->swap_map = (unsigned char *) alloc_pages(i);
+	p->swap_cache = (unsigned long *) alloc_pages(i+2);
+	p->zmap = (unsigned long *) alloc_pages(i+2);
+	if (!p->bitmap || !p->swap_map || !p->swap_cache || !p->zmap)
+		goto no_mem;
+	if (!(header = (char *) get_free_page()))
+		goto no_mem;
+	rw_swap_pages(READ, SWP_ENTRY(type,0), 1, header);
+	if (strncmp("SWAP-SPACE",header+4086,10)) {
 		printk("Unable to find swap-space signature\n\r");
-		free_page((long) swap_bitmap);
-		swap_bitmap = NULL;
-		return;
+		free_page((long) header);
+		goto bad;
 	}
-	memset(swap_bitmap+4086,0,10);
+	memset(header+4086,0,10);
 	for (i = 0 ; i < SWAP_BITS ; i++) {
 		if (i == 1)
 			i = swap_size;
-		if (bit(swap_bitmap,i)) {
+		if (bit(header,i)) {
 			printk("Bad swap-space bit-map\n\r");
-			free_page((long) swap_bitmap);
-			swap_bitmap = NULL;
-			return;
+			free_page((long) header);
+			goto bad;
 		}
 	}
+/*
+ * The header only has room for the first SWAP_BITS pages. The rest of
+ * a bigger area has no bad pages we could know of, so it is all free.
+ */
+	memset(p->bitmap, 0, PAGE_SIZE << bitmap_order(p));
+	memcpy(p->bitmap, header, PAGE_SIZE);
+	free_page((long) header);
+	for (i = SWAP_BITS ; i < swap_size ; i++)
+		setbit(p->bitmap,i);
 	j = 0;
 	for (i = 1 ; i < swap_size ; i++)
-		if (bit(swap_bitmap,i))
+		if (bit(p->bitmap,i))
 			j++;
-	if (!j) {
-		free_page((long) swap_bitmap);
-		swap_bitmap = NULL;
-		return;
+	if (!j)
+		goto bad;
+	i = p->map_order;
+	memset(p->swap_map, 0, PAGE_SIZE << i);
+	memset(p->swap_cache, 0, PAGE_SIZE << (i+2));
+	memset(p->zmap, 0, PAGE_SIZE << (i+2));
+	p->nr_free = j;
+	enable_swap_area(type);
+	if (!cluster_buf &&
+	    !(cluster_buf = (char *) alloc_pages(SWAP_CLUSTER_ORDER)))
+		printk("No memory for swap clusters: writing pages singly\n\r");
+	printk("Adding swap: %d pages (%d bytes) swap-space, priority %d\n\r",
+		j,j*4096,prio);
+	return 0;
+no_mem:
+	printk("Unable to start swapping: out of memory :-)\n\r");
+	p->swap_file = NULL;
+	free_swap_area(p);
+	return -ENOMEM;
+bad:
+	p->swap_file = NULL;
+	free_swap_area(p);
+	return -EINVAL;
+}
+
+void init_swapping(void)
+{
+	if (kernel_thread(kswapd) < 0)
+		printk("Unable to start kswapd\n\r");
+	if (SWAP_DEV)
+		add_swap_area(SWAP_DEV, NULL, --least_priority);
+}
+
+/*
+ * Bring back everything that is in area 'type', which nobody can put
+ * new pages in any more. Reading a page in sleeps, and the page tables
+ * may be gone by the time we're back, so after each read we start over:
+ * by then the page is in the swap cache, and mapping it doesn't sleep.
+ *
+ * Pages we bring back are marked dirty, as are the ones mapped from the
+ * swap cache of the area, as it won't be there for them to be dropped
+ * to. Returns 0 when the area is no longer used.
+ */
+static int try_to_unuse(int type)
+{
+	struct swap_info_struct * p = swap_info + type;
+	struct task_struct * t;
+	unsigned long * dir, * pg_table;
+	unsigned long pte, page;
+	int i, j;
+
+	while (cluster_base && SWP_TYPE(cluster_base) == type)
+		if (cluster_writing)
+			schedule();
+		else
+			write_swap_cluster();
+repeat:
+	for_each_task(t) {
+		if (is_idle(t))
+			continue;
+		dir = (unsigned long *) t->tss.cr3;
+		for (i = FIRST_VM_DIR ; i <= LAST_VM_DIR ; i++) {
+			if (!(1 & dir[i]))
+				continue;
+			pg_table = (unsigned long *) (0xfffff000 & dir[i]);
+			for (j = 0 ; j < 1024 ; j++) {
+				if (!(pte = pg_table[j]))
+					continue;
+				if (1 & pte) {
+					page = pte & 0xfffff000;
+					if (page >= LOW_MEM && page < HIGH_MEMORY &&
+					    page_swap[MAP_NR(page)] &&
+					    SWP_TYPE(page_swap[MAP_NR(page)]) == type)
+						pg_table[j] |= PAGE_DIRTY;
+					continue;
+				}
+				pte >>= 1;
+				if (SWP_TYPE(pte) != type)
+					continue;
+				if ((page = swap_cached(pte))) {
+					map_cached_page(pg_table + j, pte, page);
+					pg_table[j] |= PAGE_DIRTY;
+					continue;
+				}
+				if (!(page = get_free_page()))
+					return -ENOMEM;
+				read_swap_page(pte, (char *) page);
+				if (swap_cached(pte) || !swap_count(pte)) {
+					free_page(page);
+					goto repeat;
+				}
+				add_to_swap_cache(page, pte);
+/* held as if read ahead, until we get back to it */
+				ra_add(page);
+				goto repeat;
+			}
+		}
 	}
-	printk("Swap device ok: %d pages (%d bytes) swap-space\n\r",j,j*4096);
+	shrink_readahead(RA_PAGES);
+	for (i = 1 ; i < p->pages ; i++)
+		if ((page = p->swap_cache[i]))
+			delete_from_swap_cache(page);
+	for (i = 1 ; i < p->pages ; i++)
+		if (p->swap_map[i])
+			return -EBUSY;
+	return 0;
+}
+
+/*
+ * swapon() and swapoff() take the name of a block device or of a
+ * regular file. Without SWAP_FLAG_PREFER an area gets a priority below
+ * all the ones before it, so they fill up in the order they were added:
+ * give a ramdisk a high one, and it is used before any of the disks.
+ */
+int sys_swapon(const char * specialfile, int swap_flags)
+{
+	struct m_inode * inode;
+	int dev, prio, error;
+
+	if (!suser())
+		return -EPERM;
+	if (!(inode = namei(specialfile)))
+		return -ENOENT;
+	if (S_ISBLK(inode->i_mode)) {
+		dev = inode->i_zone[0];
+		iput(inode);
+		inode = NULL;
+	} else if (S_ISREG(inode->i_mode))
+		dev = inode->i_dev;
+	else {
+		iput(inode);
+		return -EINVAL;
+	}
+	if (swap_flags & SWAP_FLAG_PREFER)
+		prio = swap_flags & SWAP_FLAG_PRIO_MASK;
+	else
+		prio = --least_priority;
+	if ((error = add_swap_area(dev, inode, prio)) && inode)
+		iput(inode);
+	return error;
+}
+
+int sys_swapoff(const char * specialfile)
+{
+	struct m_inode * inode;
+	struct swap_info_struct * p;
+	int type, error;
+
+	if (!suser())
+		return -EPERM;
+	if (!(inode = namei(specialfile)))
+		return -ENOENT;
+	for (type = swap_list ; type >= 0 ; type = p->next) {
+		p = swap_info + type;
+		if (S_ISBLK(inode->i_mode) ?
+		    !p->swap_file && p->dev == inode->i_zone[0] :
+		    p->swap_file == inode)
+			break;
+	}
+	iput(inode);
+	if (type < 0)
+		return -EINVAL;
+	disable_swap_area(type);
+	if ((error = try_to_unuse(type))) {
+		enable_swap_area(type);
+		return error;
+	}
+	free_swap_area(p);
+	return 0;
 }
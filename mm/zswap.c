@@ -0,0 +1,262 @@
+/*
+ *  linux/mm/zswap.c
+ */
+
+/*
+ * A compressed store in memory, in front of the swap areas. swap_out()
+ * offers it every dirty page it takes away: if the page compresses well
+ * enough, and there's room in the pool, it is kept here and never goes
+ * near the disk. It still gets a page of swap space, so that the page
+ * table entry means the same as always, but nothing is written there.
+ * When the pool is full, pages simply go to the disk as before.
+ *
+ * The compressor is of the LZ77 kind, in the block format of LZ4: a
+ * token byte with the number of literals in the high nibble and the
+ * match length less 4 in the low one (15 meaning more bytes follow),
+ * the literals, and a two-byte offset back to the match. It looks for
+ * matches through a hash of the next four bytes only, which is fast,
+ * and good enough for the pages that are worth it: the ones with lots
+ * of zeroes or repeats in them.
+ *
+ * The pool is pages taken from the free lists, split into objects of a
+ * multiple of ZCHUNK bytes. Each page holds objects of one size only,
+ * and there is a list of the pages of each size that have room left.
+ */
+
+#include <string.h>
+
+#include <asm/system.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+
+#define ZCHUNK		128
+#define ZMAX		(3 * PAGE_SIZE / 4)	/* worse than this isn't worth it */
+#define NR_ZCLASSES	(ZMAX / ZCHUNK)
+
+struct zpage {
+	struct zpage * next, * prev;
+	unsigned short size;		/* of the objects, in bytes */
+	unsigned short used;
+	unsigned long free;		/* bitmap of the free objects */
+};
+
+#define ZOBJ(zp,i) ((unsigned char *) ((zp) + 1) + (i) * (zp)->size)
+#define ZPAGE(handle) ((struct zpage *) ((handle) & 0xfffff000))
+
+static struct zpage zclass[NR_ZCLASSES];	/* list heads */
+
+struct zswap_stats zswap_stats = {0, };
+int zswap_max_pages = 0;
+
+/*
+ * Positions in the page by the hash of the four bytes there. Stale ones
+ * from earlier pages don't matter, as every match is checked, so this
+ * never needs clearing.
+ */
+#define ZHASH_BITS 12
+#define ZHASH(v) (((v) * 2654435761UL) >> (32 - ZHASH_BITS))
+
+static unsigned short zhash[1 << ZHASH_BITS];
+static unsigned char zbuf[ZMAX];
+
+static unsigned char * put_length(unsigned char * op, int len)
+{
+	for ( ; len >= 255 ; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+/* compress a page into 'out': returns the length, or 0 if over 'max' */
+static int lz_compress(const unsigned char * in, unsigned char * out, int max)
+{
+	const unsigned char * ip = in, * anchor = in, * ref;
+	const unsigned char * end = in + PAGE_SIZE;
+	unsigned char * op = out, * oend = out + max;
+	unsigned long v;
+	int h, lit, len;
+
+	while (ip + 4 <= end) {
+		v = *(const unsigned long *) ip;
+		h = ZHASH(v);
+		ref = in + zhash[h];
+		zhash[h] = ip - in;
+		if (ref >= ip || *(const unsigned long *) ref != v) {
+			ip++;
+			continue;
+		}
+		for (len = 4 ; ip + len < end && ip[len] == ref[len] ; len++)
+			/* nothing */;
+		lit = ip - anchor;
+		if (op + lit + lit/255 + len/255 + 5 > oend)
+			return 0;
+		*op++ = ((lit < 15 ? lit : 15) << 4) | (len-4 < 15 ? len-4 : 15);
+		if (lit >= 15)
+			op = put_length(op, lit - 15);
+		memcpy(op, anchor, lit);
+		op += lit;
+		*op++ = (ip - ref) & 0xff;
+		*op++ = (ip - ref) >> 8;
+		if (len-4 >= 15)
+			op = put_length(op, len - 4 - 15);
+		ip += len;
+		anchor = ip;
+	}
+	if (anchor < end) {
+		lit = end - anchor;
+		if (op + lit + lit/255 + 2 > oend)
+			return 0;
+		*op++ = (lit < 15 ? lit : 15) << 4;
+		if (lit >= 15)
+			op = put_length(op, lit - 15);
+		memcpy(op, anchor, lit);
+		op += lit;
+	}
+	return op - out;
+}
+
+/* the other way round: 'out' is a page, and always gets filled */
+static void lz_decompress(const unsigned char * ip, unsigned char * out)
+{
+	unsigned char * op = out, * oend = out + PAGE_SIZE;
+	const unsigned char * ref;
+	int token, len;
+
+	for (;;) {
+		token = *ip++;
+		if ((len = token >> 4) == 15)
+			do len += *ip; while (*ip++ == 255);
+		if (len > oend - op)
+			len = oend - op;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+		if (op >= oend)
+			break;
+		ref = op - (ip[0] | (ip[1] << 8));
+		ip += 2;
+		if ((len = token & 15) == 15)
+			do len += *ip; while (*ip++ == 255);
+		len += 4;
+		if (len > oend - op)
+			len = oend - op;
+		while (len--)		/* may overlap: byte by byte */
+			*op++ = *ref++;
+		if (op >= oend)
+			break;
+	}
+}
+
+/* an object of 'size' bytes, or 0. Safe at interrupt level */
+static unsigned long zalloc(int size)
+{
+	struct zpage * head = zclass + (size / ZCHUNK - 1);
+	struct zpage * zp;
+	unsigned long flags;
+	int i;
+
+	save_flags(flags);
+	cli();
+	if ((zp = head->next) == head) {
+		if (zswap_stats.pool_pages >= zswap_max_pages ||
+		    nr_free_pages <= pages_min ||
+		    !(zp = (struct zpage *) alloc_pages(0))) {
+			restore_flags(flags);
+			return 0;
+		}
+		zswap_stats.pool_pages++;
+		zp->size = size;
+		zp->used = 0;
+		i = (PAGE_SIZE - sizeof(struct zpage)) / size;
+		zp->free = (i >= 32) ? ~0UL : (1UL << i) - 1;
+		zp->next = head->next;
+		zp->prev = head;
+		head->next->prev = zp;
+		head->next = zp;
+	}
+	__asm__("bsfl %1,%0":"=r" (i):"r" (zp->free));
+	zp->free &= ~(1UL << i);
+	zp->used++;
+	if (!zp->free) {
+		zp->prev->next = zp->next;
+		zp->next->prev = zp->prev;
+	}
+	restore_flags(flags);
+	return (unsigned long) ZOBJ(zp,i);
+}
+
+static void zfree(unsigned long handle)
+{
+	struct zpage * zp = ZPAGE(handle);
+	struct zpage * head = zclass + (zp->size / ZCHUNK - 1);
+	unsigned long flags;
+	int i = (handle - (unsigned long) ZOBJ(zp,0)) / zp->size;
+
+	save_flags(flags);
+	cli();
+	if (!zp->free) {
+		zp->next = head->next;
+		zp->prev = head;
+		head->next->prev = zp;
+		head->next = zp;
+	}
+	zp->free |= 1UL << i;
+	if (!--zp->used) {
+		zp->prev->next = zp->next;
+		zp->next->prev = zp->prev;
+		free_page((unsigned long) zp);
+		zswap_stats.pool_pages--;
+	}
+	restore_flags(flags);
+}
+
+/*
+ * Compress the page at 'page' into the pool. Returns a handle for it,
+ * or 0 if it doesn't compress well or there's no room. Doesn't sleep.
+ */
+unsigned long zswap_store(unsigned long page)
+{
+	unsigned long handle;
+	int len, size;
+
+	if (!zswap_max_pages)
+		return 0;
+	if (!(len = lz_compress((unsigned char *) page, zbuf, ZMAX))) {
+		zswap_stats.rejected++;
+		return 0;
+	}
+	size = (len + ZCHUNK - 1) & ~(ZCHUNK - 1);
+	if (!(handle = zalloc(size))) {
+		zswap_stats.pool_full++;
+		return 0;
+	}
+	memcpy((void *) handle, zbuf, len);
+	zswap_stats.stored++;
+	zswap_stats.bytes += size;
+	return handle;
+}
+
+void zswap_load(unsigned long handle, unsigned long page)
+{
+	lz_decompress((unsigned char *) handle, (unsigned char *) page);
+	zswap_stats.loads++;
+}
+
+void zswap_free(unsigned long handle)
+{
+	zswap_stats.stored--;
+	zswap_stats.bytes -= ZPAGE(handle)->size;
+	zfree(handle);
+}
+
+void zswap_init(void)
+{
+	int i;
+
+	for (i = 0 ; i < NR_ZCLASSES ; i++)
+		zclass[i].next = zclass[i].prev = zclass + i;
+/* no more than a fifth of memory */
+	zswap_max_pages = nr_free_pages / 5;
+}